@@ -0,0 +1,82 @@
+// Not meant to be run: the compile_benchmark target times how long it takes
+// to compile this file, with and without STENCIL_EXTERN_TEMPLATES. It should
+// instantiate roughly what a typical kernel translation unit does.
+#include <decomposition.hpp>
+#include <expression.hpp>
+#include <solver.hpp>
+
+namespace stencil {
+template<u32 dim, typename T>
+void kernels(grid<dim, T>& a, grid<dim, T>& b, grid<dim, T>& c)
+{
+    const std::array<i64, dim> zero = repeat<i64, dim>(0);
+    a.fill(T(0));
+    b.fill_halo(T(1));
+    c.copy_halo_from(a, repeat<i32, dim>(0));
+    iterate<1>(
+        [&](const std::array<u64, dim>&, accessor<1, dim, T, T>& acc) {
+            acc.template get<1>(zero) = acc.template get<0>(zero);
+        },
+        a,
+        b);
+    iterate<0>(
+        [&](const std::array<u64, dim>&, accessor<0, dim, T, T, T>& acc) {
+            acc.template get<2>(zero) =
+                acc.template get<0>(zero) + acc.template get<1>(zero);
+        },
+        a,
+        b,
+        c);
+
+    auto u = field<0>();
+    apply(fuse(assign<1>(u + T(0.1) * laplace(u)),
+               assign<2>(field<1>() - T(0.1) * laplace(field<1>()))),
+          a,
+          b,
+          c);
+
+    std::vector<std::array<i64, dim>> offsets(1, zero);
+    for (u32 i = 0; i < dim; ++i) {
+        std::array<i64, dim> offset = zero;
+        offset[i] = -1;
+        offsets.push_back(offset);
+        offset[i] = 1;
+        offsets.push_back(offset);
+    }
+    std::vector<T> coefficients(offsets.size(), T(-1));
+    coefficients[0] = T(2 * dim);
+    stencil_operator<dim, 1, T> op(offsets, coefficients);
+    conjugate_gradient<dim, T>(a).solve(op, a, b, T(1e-6), 100);
+    bicgstab<dim, T>(a).solve(op, a, b, T(1e-6), 100);
+}
+
+template<u32 dim, typename T>
+void instantiate()
+{
+    const std::array<u64, dim> size = repeat<u64, dim>(8);
+    buffer_set<dim, T, T, T> buffers(size + repeat<u64, dim>(2));
+    grid_set<dim, T, T, T> grids(size, 1, repeat<u64, dim>(1), buffers);
+    kernels(grids.template get<0>(),
+            grids.template get<1>(),
+            grids.template get<2>());
+
+    decomposed_grid<dim, T, T> decomposed(size, 1, 4);
+    decomposed.template exchange_halo<0>();
+    decomposed.template iterate<1, 0, 1>(
+        [](const std::array<u64, dim>&, accessor<1, dim, T, T>& acc) {
+            acc.template get<1>(repeat<i64, dim>(0)) =
+                acc.template get<0>(repeat<i64, dim>(1));
+        });
+    decomposed.rebalance();
+}
+
+void instantiate_all()
+{
+    instantiate<1, float>();
+    instantiate<1, double>();
+    instantiate<2, float>();
+    instantiate<2, double>();
+    instantiate<3, float>();
+    instantiate<3, double>();
+}
+}
@@ -1,9 +1,9 @@
 #include <SDL.h>
-#include <buffer.hpp>
 #include <cmath>
 #include <cstdlib>
+#include <decomposition.hpp>
+#include <extract.hpp>
 #include <iostream>
-#include <vector>
 #define ASSERT_SDL(expr)                                                       \
     if (!(expr)) {                                                             \
         std::cerr << SDL_GetError() << std::endl;                              \
@@ -21,83 +21,78 @@ double distsq(double x1, double y1, double x2, double y2)
 
 struct simulation
 {
-    std::vector<buffer_set<2, double, double>*> bufs;
-    std::vector<grid_set<2, double, double>*> grids;
+    decomposed_grid<2, double, double> grids;
+    colormap colors;
+    std::vector<image<rgba8>> frames;
     double t;
     u32 itercount;
 
     simulation()
-        : t(0)
+        : grids({ 800, 800 }, 1, 4)
+        , colors(colormap::grayscale(0, 1))
+        , frames(grids.subdomain_count())
+        , t(0)
         , itercount(0)
     {
-        for (size_t i = 0; i < 4; ++i) {
-            std::array<u64, 2> bufsize = { 402, 402 };
-            std::array<u64, 2> gridsize = { 400, 400 };
-            bufs.push_back(new buffer_set<2, double, double>(bufsize));
-            grids.push_back(new grid_set<2, double, double>(
-                gridsize, 1, { 1, 1 }, *bufs[i]));
-            grids.back()->get<0>().fill(0.0);
-        }
-    }
-
-    grid_set<2, double, double>::subset_t<double, double> get_buffers_ordered(
-        size_t i)
-    {
-        if (itercount % 2 == 0) {
-            return grids[i]->subset<0, 1>();
-        } else {
-            return grids[i]->subset<1, 0>();
-        }
+        grids.fill<0>(0.0);
+        grids.fill<1>(0.0);
     }
 
-    void run_one_iteration(SDL_Renderer* renderer)
+    template<u32 src, u32 dst>
+    void step(SDL_Texture* texture)
     {
-        std::vector<grid_set<2, double, double>::subset_t<double, double>> ord;
-        for (size_t i = 0; i < 4; ++i) {
-            ord.emplace_back(get_buffers_ordered(i));
-        }
-        for (size_t i = 0; i < 4; ++i) {
-            for (size_t j = 0; j < 4; ++j) {
-                if (i == j) {
-                    continue;
-                }
-                i32 x = (j & 1) - (i & 1);
-                i32 y = ((j & 2) - (i & 2)) >> 1;
-                ord[i].get<0>().copy_halo_from(ord[j].get<0>(), { x, y });
-            }
-        }
+        grids.exchange_halo<src>();
 
         double source_x = 400 + cos(t) * 300;
         double source_y = 400 + sin(t) * 300;
 
-        for (size_t i = 0; i < 4; ++i) {
-            u64 xoff = 400 * (i & 1), yoff = 400 * ((i & 2) >> 1);
-            ord[i].iterate<1>([&](const std::array<u64, 2>& it,
-                                  accessor<1, 2, double, double>& acc) {
-                if (distsq(source_x, source_y, it[0] + xoff, it[1] + yoff) <
-                    25) {
-                    acc.get<1>({ 0, 0 }) = 1.0;
-                } else {
-                    acc.get<1>({ 0, 0 }) =
-                        acc.get<0>({ 0, 0 }) +
-                        0.2 *
-                            ((acc.get<0>({ -1, 0 }) - 2 * acc.get<0>({ 0, 0 }) +
-                              acc.get<0>({ 1, 0 })) +
-                             (acc.get<0>({ 0, -1 }) - 2 * acc.get<0>({ 0, 0 }) +
-                              acc.get<0>({ 0, 1 })));
-                }
-            });
+#pragma omp parallel for
+        for (u64 i = 0; i < grids.subdomain_count(); ++i) {
+            grids.iterate_subdomain<1, src, dst>(
+                i,
+                [&](const std::array<u64, 2>& it,
+                    accessor<1, 2, double, double>& acc) {
+                    if (distsq(source_x, source_y, it[0], it[1]) < 25) {
+                        acc.get<1>({ 0, 0 }) = 1.0;
+                    } else {
+                        acc.get<1>({ 0, 0 }) =
+                            acc.get<0>({ 0, 0 }) +
+                            0.2 * ((acc.get<0>({ -1, 0 }) -
+                                    2 * acc.get<0>({ 0, 0 }) +
+                                    acc.get<0>({ 1, 0 })) +
+                                   (acc.get<0>({ 0, -1 }) -
+                                    2 * acc.get<0>({ 0, 0 }) +
+                                    acc.get<0>({ 0, 1 })));
+                    }
+                });
         }
 
-        for (size_t i = 0; i < 4; ++i) {
-            u64 xoff = 400 * (i & 1), yoff = 400 * ((i & 2) >> 1);
-            ord[i].iterate<1>([&](const std::array<u64, 2>& it,
-                                  accessor<1, 2, double, double>& acc) {
-                int color = acc.get<1>({ 0, 0 }) * 255;
-                SDL_SetRenderDrawColor(
-                    renderer, color, color, color, SDL_ALPHA_OPAQUE);
-                SDL_RenderDrawPoint(renderer, it[0] + xoff, it[1] + yoff);
-            });
+#pragma omp parallel for
+        for (u64 i = 0; i < grids.subdomain_count(); ++i) {
+            render(grids.get(i).template get<dst>(),
+                   slice<2>(0, 1),
+                   colors,
+                   frames[i]);
+        }
+
+        for (u64 i = 0; i < grids.subdomain_count(); ++i) {
+            const SDL_Rect rect = { static_cast<int>(grids.origin(i)[0]),
+                                    static_cast<int>(grids.origin(i)[1]),
+                                    static_cast<int>(frames[i].width()),
+                                    static_cast<int>(frames[i].height()) };
+            ASSERT_SDL(!SDL_UpdateTexture(texture,
+                                          &rect,
+                                          frames[i].data(),
+                                          frames[i].width() * sizeof(rgba8)));
+        }
+    }
+
+    void run_one_iteration(SDL_Texture* texture)
+    {
+        if (itercount % 2 == 0) {
+            step<0, 1>(texture);
+        } else {
+            step<1, 0>(texture);
         }
 
         t = t + .02;
@@ -121,6 +116,13 @@ int main()
     ASSERT_SDL(!SDL_RenderClear(renderer));
     SDL_RenderPresent(renderer);
 
+    SDL_Texture* texture = SDL_CreateTexture(renderer,
+                                             SDL_PIXELFORMAT_RGBA32,
+                                             SDL_TEXTUREACCESS_STREAMING,
+                                             800,
+                                             800);
+    ASSERT_SDL(texture != nullptr);
+
     simulation sim;
 
     SDL_Event event;
@@ -135,7 +137,8 @@ int main()
                     break;
             }
         }
-        sim.run_one_iteration(renderer);
+        sim.run_one_iteration(texture);
+        ASSERT_SDL(!SDL_RenderCopy(renderer, texture, nullptr, nullptr));
         SDL_RenderPresent(renderer);
     }
 }
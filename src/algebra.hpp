@@ -0,0 +1,244 @@
+#pragma once
+
+#include <buffer.hpp>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+
+namespace stencil {
+
+// Bulk operations on the interior cells of grids of the same size, as needed
+// by time integrators and Krylov solvers. They work on whole rows along the
+// first dimension, so the inner loops are contiguous and vectorize, and the
+// rows are spread over OpenMP threads. The grids don't have to share a
+// buffer layout, and fields may be of different (e.g. mixed) types; values
+// are converted to the value_type of the destination.
+
+// dst = src
+template<u32 dim, typename D, typename S>
+void copy(grid<dim, D>& dst, grid<dim, S>& src)
+{
+    using V = typename grid<dim, D>::value_type;
+    _for_each_row(false,
+                  [](u64 length, storage_t<D>* d, storage_t<S>* s) {
+                      const storage_t<S>* cs = s;
+                      STENCIL_OMP(simd)
+                      for (u64 i = 0; i < length; ++i) {
+                          field_traits<D>::ref(d + i) =
+                              static_cast<V>(field_traits<S>::ref(cs + i));
+                      }
+                  },
+                  dst,
+                  src);
+}
+
+// dst = src, halo included. The grids need the same halo size.
+template<u32 dim, typename D, typename S>
+void copy_raw(grid<dim, D>& dst, grid<dim, S>& src)
+{
+    using V = typename grid<dim, D>::value_type;
+    _for_each_row(true,
+                  [](u64 length, storage_t<D>* d, storage_t<S>* s) {
+                      const storage_t<S>* cs = s;
+                      STENCIL_OMP(simd)
+                      for (u64 i = 0; i < length; ++i) {
+                          field_traits<D>::ref(d + i) =
+                              static_cast<V>(field_traits<S>::ref(cs + i));
+                      }
+                  },
+                  dst,
+                  src);
+}
+
+// Exchanges the cells of a and b. To swap two whole grids, std::swap them
+// instead, which only swaps their buffers.
+template<u32 dim, typename T>
+void swap_contents(grid<dim, T>& a, grid<dim, T>& b)
+{
+    _for_each_row(false,
+                  [](u64 length, storage_t<T>* x, storage_t<T>* y) {
+                      std::swap_ranges(x, x + length, y);
+                  },
+                  a,
+                  b);
+}
+
+// x = alpha * x
+template<u32 dim, typename T>
+void scale(const typename grid<dim, T>::value_type& alpha, grid<dim, T>& x)
+{
+    using V = typename grid<dim, T>::value_type;
+    _for_each_row(false,
+                  [&](u64 length, storage_t<T>* p) {
+                      const storage_t<T>* cp = p;
+                      STENCIL_OMP(simd)
+                      for (u64 i = 0; i < length; ++i) {
+                          field_traits<T>::ref(p + i) = static_cast<V>(
+                              alpha * field_traits<T>::ref(cp + i));
+                      }
+                  },
+                  x);
+}
+
+// y = alpha * x + y
+template<u32 dim, typename X, typename Y>
+void axpy(const typename grid<dim, Y>::value_type& alpha,
+          grid<dim, X>& x,
+          grid<dim, Y>& y)
+{
+    using V = typename grid<dim, Y>::value_type;
+    _for_each_row(false,
+                  [&](u64 length, storage_t<X>* px, storage_t<Y>* py) {
+                      const storage_t<X>* cx = px;
+                      const storage_t<Y>* cy = py;
+                      STENCIL_OMP(simd)
+                      for (u64 i = 0; i < length; ++i) {
+                          field_traits<Y>::ref(py + i) = static_cast<V>(
+                              alpha * field_traits<X>::ref(cx + i) +
+                              field_traits<Y>::ref(cy + i));
+                      }
+                  },
+                  x,
+                  y);
+}
+
+// z = a * x + b * y
+template<u32 dim, typename Z, typename X, typename Y>
+void lincomb(grid<dim, Z>& z,
+             const typename grid<dim, Z>::value_type& a,
+             grid<dim, X>& x,
+             const typename grid<dim, Z>::value_type& b,
+             grid<dim, Y>& y)
+{
+    using V = typename grid<dim, Z>::value_type;
+    _for_each_row(
+        false,
+        [&](u64 length, storage_t<Z>* pz, storage_t<X>* px, storage_t<Y>* py) {
+            const storage_t<X>* cx = px;
+            const storage_t<Y>* cy = py;
+            STENCIL_OMP(simd)
+            for (u64 i = 0; i < length; ++i) {
+                field_traits<Z>::ref(pz + i) =
+                    static_cast<V>(a * field_traits<X>::ref(cx + i) +
+                                   b * field_traits<Y>::ref(cy + i));
+            }
+        },
+        z,
+        x,
+        y);
+}
+
+// The sum of x * y over the interior, computed in the value_type of x.
+template<u32 dim, typename X, typename Y>
+typename grid<dim, X>::value_type dot(grid<dim, X>& x, grid<dim, Y>& y)
+{
+    using V = typename grid<dim, X>::value_type;
+    const std::array<u64, dim> size = x.size();
+    assert(y.size() == size);
+    const i64 rows = _row_count<dim>(size);
+    const bool parallel = rows * size[0] >= _parallel_threshold;
+    (void)parallel;
+    const isa target = selected_isa();
+    V result = 0;
+    STENCIL_OMP(
+        parallel for schedule(static) reduction(+ : result) if (parallel))
+    for (i64 row = 0; row < rows; ++row) {
+        const std::array<u64, dim> start = _row_start<dim>(row, size);
+        const storage_t<X>* cx = &x.get(start);
+        const storage_t<Y>* cy = &y.get(start);
+        V sum = 0;
+        _maybe_dispatched(target, [&] {
+            STENCIL_OMP(simd reduction(+ : sum))
+            for (u64 i = 0; i < size[0]; ++i) {
+                sum += static_cast<V>(field_traits<X>::ref(cx + i)) *
+                       static_cast<V>(field_traits<Y>::ref(cy + i));
+            }
+        });
+        result += sum;
+    }
+    return result;
+}
+
+template<typename Func, std::size_t... I>
+void _for_each_field(const Func& func, std::index_sequence<I...>)
+{
+    (void)std::initializer_list<int>{ (
+        func(std::integral_constant<u32, I>()), 0)... };
+}
+
+// The same operations on every field of grid_sets. Scalars are converted to
+// the value_type of each field.
+template<u32 dim, typename... T>
+void copy(grid_set<dim, T...>& dst, grid_set<dim, T...>& src)
+{
+    _for_each_field(
+        [&](auto i) {
+            copy(dst.template get<i>(), src.template get<i>());
+        },
+        std::index_sequence_for<T...>());
+}
+
+template<u32 dim, typename... T>
+void copy_raw(grid_set<dim, T...>& dst, grid_set<dim, T...>& src)
+{
+    _for_each_field(
+        [&](auto i) {
+            copy_raw(dst.template get<i>(), src.template get<i>());
+        },
+        std::index_sequence_for<T...>());
+}
+
+template<u32 dim, typename... T>
+void swap_contents(grid_set<dim, T...>& a, grid_set<dim, T...>& b)
+{
+    _for_each_field(
+        [&](auto i) {
+            swap_contents(a.template get<i>(), b.template get<i>());
+        },
+        std::index_sequence_for<T...>());
+}
+
+template<typename A, u32 dim, typename... T>
+void scale(const A& alpha, grid_set<dim, T...>& x)
+{
+    _for_each_field(
+        [&](auto i) {
+            auto& field = x.template get<i>();
+            using V = typename std::decay_t<decltype(field)>::value_type;
+            scale(static_cast<V>(alpha), field);
+        },
+        std::index_sequence_for<T...>());
+}
+
+template<typename A, u32 dim, typename... T>
+void axpy(const A& alpha, grid_set<dim, T...>& x, grid_set<dim, T...>& y)
+{
+    _for_each_field(
+        [&](auto i) {
+            auto& field = y.template get<i>();
+            using V = typename std::decay_t<decltype(field)>::value_type;
+            axpy(static_cast<V>(alpha), x.template get<i>(), field);
+        },
+        std::index_sequence_for<T...>());
+}
+
+template<typename A, u32 dim, typename... T>
+void lincomb(grid_set<dim, T...>& z,
+             const A& a,
+             grid_set<dim, T...>& x,
+             const A& b,
+             grid_set<dim, T...>& y)
+{
+    _for_each_field(
+        [&](auto i) {
+            auto& field = z.template get<i>();
+            using V = typename std::decay_t<decltype(field)>::value_type;
+            lincomb(field,
+                    static_cast<V>(a),
+                    x.template get<i>(),
+                    static_cast<V>(b),
+                    y.template get<i>());
+        },
+        std::index_sequence_for<T...>());
+}
+}
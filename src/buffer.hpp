@@ -1,10 +1,18 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <dispatch.hpp>
+#include <instances.hpp>
 #include <loop.hpp>
+#include <memory>
+#include <precision.hpp>
+#include <region.hpp>
 #include <type_traits>
 #include <typelist/typelist.hpp>
 #include <util.hpp>
+#include <utility>
 
 #include <iostream>
 
@@ -16,29 +24,67 @@ template<u32 rad, typename Func, u32 dim, typename... T>
 void _iterate_impl(std::tuple<grid<dim, T>&...>& buf,
                    const std::array<u64, dim>& from,
                    const std::array<u64, dim>& to,
-                   std::tuple<T*...> cnt_init,
+                   std::tuple<storage_t<T>*...> cnt_init,
                    const Func& func);
 
 template<u32 rad, typename Func, u32 dim, typename T>
 void iterate_halo(grid<dim, T>& buf, const Func& func);
 
+template<typename Func, u32 dim, typename... T>
+void _for_each_row(bool raw, const Func& func, grid<dim, T>&... buf);
+
 template<u32 rad, u32 dim, typename... T>
 class accessor;
 
+// Describes the part of a neighbouring grid's interior which lies in the halo
+// of another grid. src_from is given in interior coordinates of the source,
+// dst_from in raw coordinates of the destination.
+template<u32 dim>
+struct halo_overlap
+{
+    std::array<u64, dim> src_from, dst_from, len;
+
+    halo_overlap()
+        : src_from(repeat<u64, dim>(0))
+        , dst_from(repeat<u64, dim>(0))
+        , len(repeat<u64, dim>(0))
+    {}
+
+    halo_overlap(const std::array<u64, dim>& src_from,
+                 const std::array<u64, dim>& dst_from,
+                 const std::array<u64, dim>& len)
+        : src_from(src_from)
+        , dst_from(dst_from)
+        , len(len)
+    {}
+
+    bool empty() const
+    {
+        for (u32 i = 0; i < dim; ++i) {
+            if (len[i] == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
 template<u32 dim, typename T>
 class buffer : not_copyable
 {
-    const std::array<u64, dim> m_size;
-    const std::array<u64, dim> m_stride;
-    T* m_data;
+    std::array<u64, dim> m_size;
+    std::array<u64, dim> m_stride;
+    std::unique_ptr<storage_t<T>[]> m_data;
 
-    static T* _init_data(const std::array<u64, dim>& size)
+    static std::unique_ptr<storage_t<T>[]> _init_data(
+        const std::array<u64, dim>& size)
     {
         u64 buffer_length = 1;
         for (u32 i = 0; i < dim; ++i) {
             buffer_length *= size[i];
         }
-        return new T[buffer_length];
+        return std::unique_ptr<storage_t<T>[]>(
+            new storage_t<T>[buffer_length]);
     }
 
     static std::array<u64, dim> _init_stride(const std::array<u64, dim>& size)
@@ -58,21 +104,15 @@ public:
         , m_data(_init_data(size))
     {}
 
-    buffer(buffer<dim, T>&& other)
-        : m_size(other.m_size)
-        , m_stride(other.m_stride)
-        , m_data(other.m_data)
-    {
-        other.m_data = nullptr;
-    }
-
-    ~buffer() { delete m_data; }
+    buffer(buffer<dim, T>&& other) = default;
+    buffer& operator=(buffer<dim, T>&& other) = default;
 
+    inline const std::array<u64, dim>& size() const { return m_size; }
     inline const std::array<u64, dim>& stride() const { return m_stride; }
 
-    inline const T& get(u64 index) const { return m_data[index]; }
+    inline const storage_t<T>& get(u64 index) const { return m_data[index]; }
 
-    inline T& get(u64 index) { return m_data[index]; }
+    inline storage_t<T>& get(u64 index) { return m_data[index]; }
 };
 
 template<u32 dim, typename T>
@@ -81,10 +121,10 @@ class grid : not_copyable
     template<u32, u32, typename...>
     friend class accessor;
 
-    const std::array<u64, dim> m_size, m_raw_size;
-    const u32 m_halo_size;
-    buffer<dim, T>* m_buffer;
-    const u64 m_start_offset, m_raw_start_offset;
+    std::array<u64, dim> m_size, m_raw_size, m_position;
+    u32 m_halo_size;
+    std::shared_ptr<buffer<dim, T>> m_buffer;
+    u64 m_start_offset, m_raw_start_offset;
 
     static std::array<u64, dim> _init_raw_size(const std::array<u64, dim>& size,
                                                u32 halo_size)
@@ -107,15 +147,6 @@ class grid : not_copyable
         return result;
     }
 
-    static T* _init_data(const std::array<u64, dim>& size, u32 halo_size)
-    {
-        u64 buffer_length = 1;
-        for (u32 i = 0; i < dim; ++i) {
-            buffer_length *= (size[i] + 2 * halo_size);
-        }
-        return new T[buffer_length];
-    }
-
     inline u64 _compute_index(const std::array<u64, dim>& coords) const
     {
         u64 result = coords[0];
@@ -126,51 +157,98 @@ class grid : not_copyable
     }
 
 public:
+    using storage_type = storage_t<T>;
+    using value_type = typename field_traits<T>::value_type;
+
+    // Shares the ownership of buf. position is where the interior of the grid
+    // starts in the buffer.
     grid(const std::array<u64, dim>& size,
          u32 halo_size,
          const std::array<u64, dim>& position,
-         buffer<dim, T>* buffer)
+         std::shared_ptr<buffer<dim, T>> buf)
         : m_size(size)
         , m_raw_size(_init_raw_size(size, halo_size))
+        , m_position(position)
         , m_halo_size(halo_size)
-        , m_buffer(buffer)
+        , m_buffer(std::move(buf))
         , m_start_offset(_compute_index(position))
         , m_raw_start_offset(
               _compute_index(position - repeat<u64, dim>(halo_size)))
     {}
 
-    grid(grid<dim, T>&& other)
-        : m_size(other.m_size)
-        , m_raw_size(other.m_raw_size)
-        , m_halo_size(other.m_halo_size)
-        , m_buffer(other.m_buffer)
-        , m_start_offset(other.m_start_offset)
-        , m_raw_start_offset(other.m_raw_start_offset)
+    // Doesn't own buf, which has to outlive the grid.
+    grid(const std::array<u64, dim>& size,
+         u32 halo_size,
+         const std::array<u64, dim>& position,
+         buffer<dim, T>* buf)
+        : grid(size,
+               halo_size,
+               position,
+               std::shared_ptr<buffer<dim, T>>(
+                   std::shared_ptr<buffer<dim, T>>(), buf))
+    {}
+
+    // Allocates a buffer of its own, just large enough for the grid.
+    grid(const std::array<u64, dim>& size, u32 halo_size)
+        : grid(size,
+               halo_size,
+               repeat<u64, dim>(halo_size),
+               std::make_shared<buffer<dim, T>>(
+                   _init_raw_size(size, halo_size)))
+    {}
+
+    grid(grid<dim, T>&& other) = default;
+    grid& operator=(grid<dim, T>&& other) = default;
+
+    // A grid over part of the same buffer, which it shares the ownership of.
+    // from is in the interior coordinates of this grid; the view and its halo
+    // have to fit into the buffer.
+    grid view(const std::array<u64, dim>& from,
+              const std::array<u64, dim>& size,
+              u32 halo_size) const
     {
-        other.m_buffer = nullptr;
+        const std::array<u64, dim> position = m_position + from;
+        for (u32 i = 0; i < dim; ++i) {
+            assert(position[i] >= halo_size);
+            assert(position[i] + size[i] + halo_size <= m_buffer->size()[i]);
+        }
+        return grid(size, halo_size, position, m_buffer);
     }
 
-    ~grid() {}
+    grid view() const { return view(repeat<u64, dim>(0), m_size, m_halo_size); }
 
-    inline T& get(const std::array<u64, dim>& coords)
+    // A view whose interior is the interior and halo of this grid, with a new
+    // halo around it, which has to fit into the buffer as well.
+    grid raw_view(u32 halo_size) const
+    {
+        const std::array<u64, dim> position =
+            m_position - repeat<u64, dim>(m_halo_size);
+        for (u32 i = 0; i < dim; ++i) {
+            assert(position[i] >= halo_size);
+            assert(position[i] + m_raw_size[i] + halo_size <=
+                   m_buffer->size()[i]);
+        }
+        return grid(m_raw_size, halo_size, position, m_buffer);
+    }
+
+    inline storage_type& get(const std::array<u64, dim>& coords)
     {
         return m_buffer->get(m_start_offset + _compute_index(coords));
     }
 
-    inline const T& get(const std::array<u64, dim>& coords) const
+    inline const storage_type& get(const std::array<u64, dim>& coords) const
     {
         return m_buffer->get(m_start_offset + _compute_index(coords));
     }
 
-    inline T& get_raw(const std::array<u64, dim>& coords)
+    inline storage_type& get_raw(const std::array<u64, dim>& coords)
     {
         return m_buffer->get(m_raw_start_offset + _compute_index(coords));
     }
 
-    inline const T& get_raw(const std::array<u64, dim>& coords) const
+    inline const storage_type& get_raw(const std::array<u64, dim>& coords) const
     {
-        return m_buffer->get(m_raw_start_offset +
-                             _compute_index(coords, repeat<u64, dim>(0)));
+        return m_buffer->get(m_raw_start_offset + _compute_index(coords));
     }
 
     const std::array<u64, dim>& size() const { return m_size; }
@@ -178,7 +256,7 @@ public:
     const std::array<u64, dim>& stride() const { return m_buffer->stride(); }
     u32 halo_size() const { return m_halo_size; }
 
-    void fill_halo(const T& value)
+    void fill_halo(const value_type& value)
     {
         iterate_halo<0>(*this,
                         [&](const std::array<u64, dim>&,
@@ -188,23 +266,64 @@ public:
                         });
     }
 
-    void fill(const T& value)
+    void fill(const value_type& value)
     {
-        auto tup = std::tie(*this);
-        auto func = [&](std::array<u64, dim>&, accessor<0, dim, T>& acc) {
-            acc.get({ 0, 0 }) = value;
-        };
-        _iterate_impl<0, decltype(func), dim, T>(
-            tup,
-            repeat<u64, dim>(0),
-            m_raw_size,
-            std::make_tuple(&get_raw(repeat<u64, dim>(0))),
-            func);
+        const storage_type stored = static_cast<storage_type>(value);
+        _for_each_row(true,
+                      [&](u64 length, storage_type* row) {
+                          std::fill(row, row + length, stored);
+                      },
+                      *this);
+    }
+
+    halo_overlap<dim> find_halo_overlap(
+        const grid<dim, T>& other,
+        const std::array<i64, dim>& origin,
+        const std::array<i64, dim>& other_origin) const
+    {
+        std::array<u64, dim> src_from, dst_from, len;
+        for (u32 i = 0; i < dim; ++i) {
+            const i64 halo = m_halo_size;
+            const i64 from = std::max(origin[i] - halo, other_origin[i]);
+            const i64 to =
+                std::min(origin[i] + static_cast<i64>(m_size[i]) + halo,
+                         other_origin[i] + static_cast<i64>(other.m_size[i]));
+            if (to <= from) {
+                return halo_overlap<dim>();
+            }
+            len[i] = to - from;
+            src_from[i] = from - other_origin[i];
+            dst_from[i] = from - origin[i] + halo;
+        }
+        return halo_overlap<dim>(src_from, dst_from, len);
+    }
+
+    void copy_halo_from(const grid<dim, T>& other,
+                        const halo_overlap<dim>& overlap)
+    {
+        if (overlap.empty()) {
+            return;
+        }
+        std::array<u64, dim> rows = overlap.len;
+        rows[0] = 1;
+        loop<dim>(
+            repeat<u64, dim>(0), rows, [&](const std::array<u64, dim>& it) {
+                const storage_type* src = &other.get(overlap.src_from + it);
+                std::copy(
+                    src, src + overlap.len[0], &get_raw(overlap.dst_from + it));
+            });
     }
 
-    void copy_halo_from(grid<dim, T>& other, const std::array<i32, dim>& relpos)
+    void copy_halo_from(const grid<dim, T>& other,
+                        const std::array<i64, dim>& origin,
+                        const std::array<i64, dim>& other_origin)
+    {
+        copy_halo_from(other, find_halo_overlap(other, origin, other_origin));
+    }
+
+    void copy_halo_from(const grid<dim, T>& other,
+                        const std::array<i32, dim>& relpos)
     {
-        // TODO: efficient implementation with counter loop
         std::array<u64, dim> len, from_src, from_dst;
         for (u32 i = 0; i < dim; ++i) {
             if (relpos[i] < 0) {
@@ -221,10 +340,7 @@ public:
                 from_dst[i] = m_raw_size[i] - m_halo_size;
             }
         }
-        loop<dim>(
-            repeat<u64, dim>(0), len, [&](const std::array<u64, dim>& it) {
-                get_raw(from_dst + it) = other.get(from_src + it);
-            });
+        copy_halo_from(other, halo_overlap<dim>(from_src, from_dst, len));
     }
 };
 
@@ -236,7 +352,7 @@ protected:
     friend class buffer;
     const std::array<i64, ipow(2 * rad + 1, dim)> m_offset_table;
     using data_types = tl::type_list<T...>;
-    tuple_counter<T*...> m_middle;
+    tuple_counter<storage_t<T>*...> m_middle;
 
     inline static constexpr u64 _compute_table_index_impl(
         const std::array<i64, dim>& coords,
@@ -271,52 +387,124 @@ protected:
         return table;
     }
 
+    inline static std::array<i64, ipow(2 * rad + 1, dim)>
+    _init_wrapped_offset_table(const std::array<u64, dim>& buffer_stride,
+                               const std::array<u64, dim>& size,
+                               const std::array<u64, dim>& coords)
+    {
+        std::array<i64, dim> from;
+        from.fill(-static_cast<i64>(rad));
+        std::array<i64, dim> to;
+        to.fill(rad + 1);
+        // the offsets along each dimension, only wrapped around where the
+        // stencil crosses the edge
+        std::array<std::array<i64, 2 * rad + 1>, dim> shifts;
+        for (u32 i = 0; i < dim; ++i) {
+            const i64 n = size[i];
+            const i64 x = coords[i];
+            const bool wraps = x < static_cast<i64>(rad) || x + rad >= n;
+            for (i64 o = -static_cast<i64>(rad); o <= static_cast<i64>(rad);
+                 ++o) {
+                const i64 target = wraps ? ((x + o) % n + n) % n : x + o;
+                shifts[i][o + rad] = (target - x) * buffer_stride[i];
+            }
+        }
+        std::array<i64, ipow(2 * rad + 1, dim)> table;
+        loop<dim, i64>(from, to, [&](const std::array<i64, dim>& it) {
+            u64 index = _compute_table_index(it);
+            table[index] = 0;
+            for (u32 i = 0; i < dim; ++i) {
+                table[index] += shifts[i][it[i] + rad];
+            }
+        });
+        return table;
+    }
+
 public:
+    template<u32 i>
+    using value_type =
+        typename field_traits<typename data_types::template get<i>>::value_type;
+
     accessor(const std::array<u64, dim>& buffer_stride)
         : m_offset_table(_init_offset_table(buffer_stride))
     {}
 
-    inline void set_middle(const std::tuple<T*...>& middle)
+    // For the cell at coords of a periodic grid of the given size: neighbours
+    // beyond the edge wrap around to the other side.
+    accessor(const std::array<u64, dim>& buffer_stride,
+             const std::array<u64, dim>& size,
+             const std::array<u64, dim>& coords)
+        : m_offset_table(
+              _init_wrapped_offset_table(buffer_stride, size, coords))
+    {}
+
+    inline void set_middle(const std::tuple<storage_t<T>*...>& middle)
     {
         m_middle.values = middle;
     }
 
-    inline accessor<rad, dim, T...> operator+=(u64 inc)
+    inline accessor<rad, dim, T...> operator+=(i64 inc)
     {
         m_middle += inc;
         return *this;
     }
 
     template<u32 i = 0>
-    inline typename data_types::template get<i>& get(
-        const std::array<i64, dim>& coords)
+    inline typename field_traits<typename data_types::template get<i>>::reference
+    get(const std::array<i64, dim>& coords)
     {
-        return *(std::get<i>(m_middle.values) +
-                 m_offset_table[_compute_table_index(coords)]);
+        return field_traits<typename data_types::template get<i>>::ref(
+            std::get<i>(m_middle.values) +
+            m_offset_table[_compute_table_index(coords)]);
     }
 
     template<u32 i = 0>
-    inline const typename data_types::template get<i>& get(
-        const std::array<i64, dim>& coords) const
+    inline typename field_traits<
+        typename data_types::template get<i>>::const_reference
+    get(const std::array<i64, dim>& coords) const
     {
-        return *(std::get<i>(m_middle.values) +
-                 m_offset_table[_compute_table_index(coords)]);
+        return field_traits<typename data_types::template get<i>>::ref(
+            static_cast<const storage_t<typename data_types::template get<i>>*>(
+                std::get<i>(m_middle.values) +
+                m_offset_table[_compute_table_index(coords)]));
     }
 };
 
+// Iterates over [from, to) with the offset table of acc, which the callers
+// build once for all cells that share it.
+template<u32 rad, typename Func, u32 dim, typename... T>
+void _iterate_with(std::tuple<grid<dim, T>&...>& buf,
+                   const std::array<u64, dim>& from,
+                   const std::array<u64, dim>& to,
+                   std::tuple<storage_t<T>*...> cnt_init,
+                   accessor<rad, dim, T...>& acc,
+                   const Func& func)
+{
+    std::array<u64, dim> jumps;
+    const auto stride = std::get<0>(buf).stride();
+    jumps[0] = stride[0];
+    for (size_t i = 1; i < dim; ++i) {
+        jumps[i] = stride[i] - stride[i - 1] * (to[i - 1] - from[i - 1]);
+    }
+    acc.set_middle(cnt_init);
+    loop_with_counter<dim, u64, accessor<rad, dim, T...>, u64>(
+        from, to, acc, jumps, [&](std::array<u64, dim>& it, auto& cnt) {
+            func(it, cnt);
+        });
+}
+
 template<u32 rad, typename Func, u32 dim, typename... T>
 void _iterate_impl(std::tuple<grid<dim, T>&...>& buf,
                    const std::array<u64, dim>& from,
                    const std::array<u64, dim>& to,
-                   std::tuple<T*...> cnt_init,
+                   std::tuple<storage_t<T>*...> cnt_init,
                    const Func& func)
 {
     std::array<u64, dim> jumps;
     const auto stride = std::get<0>(buf).stride();
-    const auto raw_size = std::get<0>(buf).size_with_halo();
     jumps[0] = stride[0];
     for (size_t i = 1; i < dim; ++i) {
-        jumps[i] = stride[i - 1] * (raw_size[i] - to[i] + from[i]);
+        jumps[i] = stride[i] - stride[i - 1] * (to[i - 1] - from[i - 1]);
     }
     accessor<rad, dim, T...> acc(stride);
     acc.set_middle(cnt_init);
@@ -326,19 +514,251 @@ void _iterate_impl(std::tuple<grid<dim, T>&...>& buf,
         });
 }
 
+// A plain pack expansion, for_each_and_collect would instantiate a lambda and
+// a collector for every field pack.
+template<u32 dim, typename... T, std::size_t... I>
+std::tuple<storage_t<T>*...> _pointers_at_impl(
+    std::tuple<grid<dim, T>&...>& buf,
+    const std::array<u64, dim>& coords,
+    std::index_sequence<I...>)
+{
+    return std::tuple<storage_t<T>*...>(&std::get<I>(buf).get(coords)...);
+}
+
+template<u32 dim, typename... T>
+std::tuple<storage_t<T>*...> _pointers_at(std::tuple<grid<dim, T>&...>& buf,
+                                          const std::array<u64, dim>& coords)
+{
+    return _pointers_at_impl<dim, T...>(
+        buf, coords, std::index_sequence_for<T...>());
+}
+
 template<u32 rad, typename Func, u32 dim, typename... T>
 void iterate(const Func& func, grid<dim, T>&... buf)
 {
     auto bufs = std::tie(buf...);
-    auto size = std::get<0>(bufs).size();
-    auto cnt_init =
-        tl::type_list<T...>::template for_each_and_collect<std::tuple>(
-            [&](auto s) {
-                using S = decltype(s);
-                return &std::get<S::index>(bufs).get(repeat<u64, dim>(0));
-            });
-    _iterate_impl<rad, Func, dim, T...>(
-        bufs, repeat<u64, dim>(0), size, cnt_init, func);
+    _maybe_dispatched([&] {
+        _iterate_impl<rad, Func, dim, T...>(
+            bufs,
+            repeat<u64, dim>(0),
+            std::get<0>(bufs).size(),
+            _pointers_at<dim, T...>(bufs, repeat<u64, dim>(0)),
+            func);
+    });
+}
+
+template<u32 rad, typename Func, u32 dim, typename... T>
+void _iterate_region_impl(std::tuple<grid<dim, T>&...>& buf,
+                          const region<dim>& reg,
+                          const Func& func)
+{
+    assert(reg.fits(std::get<0>(buf).size()));
+    const auto count = reg.count();
+    for (u32 i = 0; i < dim; ++i) {
+        if (count[i] == 0) {
+            return;
+        }
+    }
+    if (reg.unit_step()) {
+        _iterate_impl<rad, Func, dim, T...>(
+            buf, reg.from, reg.to, _pointers_at<dim, T...>(buf, reg.from), func);
+        return;
+    }
+    std::array<i64, dim> jumps;
+    const auto stride = std::get<0>(buf).stride();
+    jumps[0] = stride[0] * reg.step[0];
+    for (size_t i = 1; i < dim; ++i) {
+        jumps[i] = static_cast<i64>(stride[i] * reg.step[i]) -
+                   static_cast<i64>(stride[i - 1] * reg.step[i - 1] *
+                                    count[i - 1]);
+    }
+    accessor<rad, dim, T...> acc(stride);
+    acc.set_middle(_pointers_at<dim, T...>(buf, reg.from));
+    std::array<u64, dim> coords;
+    loop_with_counter<dim, u64, accessor<rad, dim, T...>, i64>(
+        repeat<u64, dim>(0),
+        count,
+        acc,
+        jumps,
+        [&](std::array<u64, dim>& it, auto& cnt) {
+            for (u32 i = 0; i < dim; ++i) {
+                coords[i] = reg.from[i] + it[i] * reg.step[i];
+            }
+            func(coords, cnt);
+        });
+}
+
+template<u32 rad, typename Func, u32 dim, typename... T>
+void _iterate_masked_impl(std::tuple<grid<dim, T>&...>& buf,
+                          const run_index<dim>& runs,
+                          const Func& func)
+{
+    assert(runs.fits(std::get<0>(buf).size()));
+    const auto stride = std::get<0>(buf).stride();
+    const auto origin = _pointers_at<dim, T...>(buf, repeat<u64, dim>(0));
+    accessor<rad, dim, T...> acc(stride);
+    for (const auto& run : runs.runs()) {
+        i64 offset = 0;
+        for (u32 i = 0; i < dim; ++i) {
+            offset += run.start[i] * stride[i];
+        }
+        acc.set_middle(origin);
+        acc += offset;
+        std::array<u64, dim> it = run.start;
+        for (u64 j = 0; j < run.length; ++j, ++it[0], acc += 1) {
+            func(it, acc);
+        }
+    }
+}
+
+// Like iterate, but only visits the cells of reg.
+template<u32 rad, typename Func, u32 dim, typename... T>
+void iterate_region(const region<dim>& reg,
+                    const Func& func,
+                    grid<dim, T>&... buf)
+{
+    auto bufs = std::tie(buf...);
+    _maybe_dispatched(
+        [&] { _iterate_region_impl<rad, Func, dim, T...>(bufs, reg, func); });
+}
+
+// Like iterate, but only visits the cells listed in runs.
+template<u32 rad, typename Func, u32 dim, typename... T>
+void iterate_masked(const run_index<dim>& runs,
+                    const Func& func,
+                    grid<dim, T>&... buf)
+{
+    auto bufs = std::tie(buf...);
+    _maybe_dispatched(
+        [&] { _iterate_masked_impl<rad, Func, dim, T...>(bufs, runs, func); });
+}
+
+template<u32 rad, typename Func, u32 dim, typename... T>
+void _iterate_periodic_impl(std::tuple<grid<dim, T>&...>& buf,
+                            const Func& func)
+{
+    const auto size = std::get<0>(buf).size();
+    const auto stride = std::get<0>(buf).stride();
+    // [low, high) is the part of the grid where no neighbour wraps around
+    std::array<u64, dim> low, high;
+    bool interior = true;
+    for (u32 i = 0; i < dim; ++i) {
+        low[i] = std::min<u64>(rad, size[i]);
+        high[i] = size[i] >= 2 * rad ? size[i] - rad : low[i];
+        interior = interior && low[i] < high[i];
+    }
+    if (interior) {
+        _iterate_impl<rad, Func, dim, T...>(
+            buf, low, high, _pointers_at<dim, T...>(buf, low), func);
+    }
+
+    // The remaining cells are split into boxes which, along each dimension,
+    // either span [low, high) or have a single coordinate outside of it. The
+    // neighbours of all cells in a box wrap around the same way, so they
+    // share one offset table. Along dimension i, class c is the coordinate c
+    // below low, [low, high) itself, or a coordinate from high on.
+    std::array<u64, dim> classes;
+    for (u32 i = 0; i < dim; ++i) {
+        classes[i] = size[i] - (high[i] - low[i]) + (low[i] < high[i]);
+    }
+    loop<dim>(repeat<u64, dim>(0),
+              classes,
+              [&](const std::array<u64, dim>& c) {
+                  std::array<u64, dim> from, to;
+                  bool inside = true;
+                  for (u32 i = 0; i < dim; ++i) {
+                      const bool middle = low[i] < high[i];
+                      if (c[i] < low[i]) {
+                          from[i] = c[i];
+                          to[i] = c[i] + 1;
+                          inside = false;
+                      } else if (middle && c[i] == low[i]) {
+                          from[i] = low[i];
+                          to[i] = high[i];
+                      } else {
+                          from[i] = c[i] - low[i] - middle + high[i];
+                          to[i] = from[i] + 1;
+                          inside = false;
+                      }
+                  }
+                  if (inside) {
+                      return;
+                  }
+                  accessor<rad, dim, T...> acc(stride, size, from);
+                  _iterate_with<rad, Func, dim, T...>(
+                      buf,
+                      from,
+                      to,
+                      _pointers_at<dim, T...>(buf, from),
+                      acc,
+                      func);
+              });
+}
+
+// Like iterate, but on a periodic domain: neighbours beyond the edge of the
+// grids wrap around to the other side, so they don't need a halo. The
+// outermost rad cells are visited in boxes that share a wrapped offset table,
+// which takes about as long as filling a periodic halo would.
+template<u32 rad, typename Func, u32 dim, typename... T>
+void iterate_periodic(const Func& func, grid<dim, T>&... buf)
+{
+    auto bufs = std::tie(buf...);
+    _maybe_dispatched(
+        [&] { _iterate_periodic_impl<rad, Func, dim, T...>(bufs, func); });
+}
+
+// Grids with fewer cells are processed by a single thread.
+constexpr u64 _parallel_threshold = 1 << 15;
+
+template<u32 dim>
+inline u64 _row_count(const std::array<u64, dim>& size)
+{
+    u64 result = 1;
+    for (u32 i = 1; i < dim; ++i) {
+        result *= size[i];
+    }
+    return result;
+}
+
+// Coordinates of the first cell of the row-th row along the first dimension.
+template<u32 dim>
+inline std::array<u64, dim> _row_start(u64 row,
+                                       const std::array<u64, dim>& size)
+{
+    std::array<u64, dim> result;
+    result[0] = 0;
+    for (u32 i = 1; i < dim; ++i) {
+        result[i] = row % size[i];
+        row /= size[i];
+    }
+    return result;
+}
+
+// Calls func(length, pointers...) for every row of cells along the first
+// dimension, where the pointers point to the start of the row in each grid.
+// Covers the interior of the grids, or with raw, their halos as well. Rows
+// are spread over OpenMP threads, so func must not write shared state.
+template<typename Func, u32 dim, typename... T>
+void _for_each_row(bool raw, const Func& func, grid<dim, T>&... buf)
+{
+    auto bufs = std::tie(buf...);
+    const std::array<u64, dim> size = raw ? std::get<0>(bufs).size_with_halo()
+                                          : std::get<0>(bufs).size();
+    for (const auto& other : { (raw ? buf.size_with_halo() : buf.size())... }) {
+        assert(other == size);
+        (void)other;
+    }
+    const i64 rows = _row_count<dim>(size);
+    const bool parallel = rows * size[0] >= _parallel_threshold;
+    (void)parallel;
+    const isa target = selected_isa();
+    STENCIL_OMP(parallel for schedule(static) if (parallel))
+    for (i64 row = 0; row < rows; ++row) {
+        const std::array<u64, dim> start = _row_start<dim>(row, size);
+        _maybe_dispatched(target, [&] {
+            func(size[0], (raw ? &buf.get_raw(start) : &buf.get(start))...);
+        });
+    }
 }
 
 template<u32 rad, typename Func, u32 dim, typename T>
@@ -381,9 +801,8 @@ public:
         : m_buffers(std::make_tuple(buffer<dim, T>(size)...))
     {}
 
-    buffer_set(buffer_set<dim, T...>&& other)
-        : m_buffers(std::move(other.m_buffers))
-    {}
+    buffer_set(buffer_set<dim, T...>&& other) = default;
+    buffer_set& operator=(buffer_set<dim, T...>&& other) = default;
 
     template<u32 i>
     auto& get()
@@ -397,23 +816,38 @@ class grid_set : not_copyable
 {
     std::tuple<grid<dim, T>...> m_grids;
 
+    template<std::size_t... I>
+    grid_set(const std::array<u64, dim>& size,
+             u32 halo_size,
+             const std::array<u64, dim>& position,
+             buffer_set<dim, T...>& buffers,
+             std::index_sequence<I...>)
+        : m_grids(grid<dim, T>(size,
+                               halo_size,
+                               position,
+                               &buffers.template get<I>())...)
+    {}
+
 public:
     grid_set(const std::array<u64, dim>& size,
              u32 halo_size,
              const std::array<u64, dim>& position,
              buffer_set<dim, T...>& buffers)
-        : m_grids(
-              tl::type_list<T...>::template for_each_and_collect<std::tuple>(
-                  [&](auto t) {
-                      using item_type = decltype(t);
-                      return grid<dim, typename item_type::type>(
-                          size,
-                          halo_size,
-                          position,
-                          &buffers.template get<item_type::index>());
-                  }))
+        : grid_set(size,
+                   halo_size,
+                   position,
+                   buffers,
+                   std::index_sequence_for<T...>())
     {}
 
+    // Every grid allocates a buffer of its own.
+    grid_set(const std::array<u64, dim>& size, u32 halo_size)
+        : m_grids(grid<dim, T>(size, halo_size)...)
+    {}
+
+    grid_set(grid_set<dim, T...>&& other) = default;
+    grid_set& operator=(grid_set<dim, T...>&& other) = default;
+
     template<typename... S>
     struct subset_t
     {
@@ -422,16 +856,38 @@ public:
         template<u32 rad, typename Func>
         void iterate(const Func& func)
         {
-            auto size = std::get<0>(grids).size();
-            auto cnt_init =
-                tl::type_list<T...>::template for_each_and_collect<std::tuple>(
-                    [&](auto r) {
-                        using R = decltype(r);
-                        return &std::get<R::index>(grids).get(
-                            repeat<u64, dim>(0));
-                    });
-            _iterate_impl<rad, Func, dim, S...>(
-                grids, repeat<u64, dim>(0), size, cnt_init, func);
+            _maybe_dispatched([&] {
+                _iterate_impl<rad, Func, dim, S...>(
+                    grids,
+                    repeat<u64, dim>(0),
+                    std::get<0>(grids).size(),
+                    _pointers_at<dim, S...>(grids, repeat<u64, dim>(0)),
+                    func);
+            });
+        }
+
+        template<u32 rad, typename Func>
+        void iterate_region(const region<dim>& reg, const Func& func)
+        {
+            _maybe_dispatched([&] {
+                _iterate_region_impl<rad, Func, dim, S...>(grids, reg, func);
+            });
+        }
+
+        template<u32 rad, typename Func>
+        void iterate_masked(const run_index<dim>& runs, const Func& func)
+        {
+            _maybe_dispatched([&] {
+                _iterate_masked_impl<rad, Func, dim, S...>(grids, runs, func);
+            });
+        }
+
+        template<u32 rad, typename Func>
+        void iterate_periodic(const Func& func)
+        {
+            _maybe_dispatched([&] {
+                _iterate_periodic_impl<rad, Func, dim, S...>(grids, func);
+            });
         }
 
         template<u32 i>
@@ -455,5 +911,23 @@ public:
     {
         return std::get<i>(m_grids);
     }
+
+    template<u32 i>
+    const auto& get() const
+    {
+        return std::get<i>(m_grids);
+    }
 };
 }
+
+#ifdef STENCIL_EXTERN_TEMPLATES
+namespace stencil {
+#define STENCIL_EXTERN_BUFFER(dim, T)                                          \
+    extern template class buffer<dim, T>;                                      \
+    extern template class grid<dim, T>;
+
+STENCIL_INSTANCES(STENCIL_EXTERN_BUFFER)
+
+#undef STENCIL_EXTERN_BUFFER
+}
+#endif
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <buffer.hpp>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace stencil {
+
+template<u32 dim>
+double _halo_surface(const std::array<u64, dim>& size,
+                     const std::array<u64, dim>& layout)
+{
+    double result = 0;
+    for (u32 i = 0; i < dim; ++i) {
+        double face = 1;
+        for (u32 j = 0; j < dim; ++j) {
+            if (j != i) {
+                face *= size[j];
+            }
+        }
+        result += (layout[i] - 1) * face;
+    }
+    return result;
+}
+
+template<u32 dim>
+void _choose_layout_impl(const std::array<u64, dim>& size,
+                         u64 remaining,
+                         u32 i,
+                         std::array<u64, dim>& current,
+                         std::array<u64, dim>& best,
+                         double& best_cost)
+{
+    if (i == dim - 1) {
+        if (remaining > size[i]) {
+            return;
+        }
+        current[i] = remaining;
+        const double cost = _halo_surface<dim>(size, current);
+        if (cost < best_cost) {
+            best_cost = cost;
+            best = current;
+        }
+        return;
+    }
+    for (u64 p = 1; p <= remaining && p <= size[i]; ++p) {
+        if (remaining % p == 0) {
+            current[i] = p;
+            _choose_layout_impl<dim>(
+                size, remaining / p, i + 1, current, best, best_cost);
+        }
+    }
+}
+
+// Splits workers into a subdomain count per dimension such that the total
+// area of the cuts (and therefore the amount of halo exchanged) is minimal.
+// Throws std::invalid_argument if workers can't be factored into counts that
+// fit the size.
+template<u32 dim>
+std::array<u64, dim> choose_layout(const std::array<u64, dim>& size,
+                                   u64 workers)
+{
+    std::array<u64, dim> current, best = repeat<u64, dim>(1);
+    double best_cost = std::numeric_limits<double>::infinity();
+    _choose_layout_impl<dim>(size, workers, 0, current, best, best_cost);
+    if (best_cost == std::numeric_limits<double>::infinity()) {
+        throw std::invalid_argument(
+            "choose_layout: no layout of the workers fits the size");
+    }
+    return best;
+}
+
+template<u32 dim, typename... T>
+class decomposed_grid : not_copyable
+{
+public:
+    struct neighbor
+    {
+        u64 index;
+        halo_overlap<dim> overlap;
+    };
+
+private:
+    const std::array<u64, dim> m_size;
+    const u32 m_halo_size;
+    const std::array<u64, dim> m_layout;
+    std::array<std::vector<u64>, dim> m_cuts;
+    std::vector<grid_set<dim, T...>> m_grids;
+    std::vector<std::array<u64, dim>> m_origins;
+    std::vector<std::vector<neighbor>> m_neighbors;
+    std::vector<double> m_times;
+
+    static std::array<std::vector<u64>, dim> _init_cuts(
+        const std::array<u64, dim>& size,
+        const std::array<u64, dim>& layout)
+    {
+        std::array<std::vector<u64>, dim> result;
+        for (u32 i = 0; i < dim; ++i) {
+            for (u64 j = 0; j <= layout[i]; ++j) {
+                result[i].push_back(j * size[i] / layout[i]);
+            }
+        }
+        return result;
+    }
+
+    static std::array<i64, dim> _to_signed(const std::array<u64, dim>& coords)
+    {
+        std::array<i64, dim> result;
+        for (u32 i = 0; i < dim; ++i) {
+            result[i] = coords[i];
+        }
+        return result;
+    }
+
+    std::array<u64, dim> _layout_coords(u64 index) const
+    {
+        std::array<u64, dim> result;
+        for (u32 i = 0; i < dim; ++i) {
+            result[i] = index % m_layout[i];
+            index /= m_layout[i];
+        }
+        return result;
+    }
+
+    template<std::size_t... I>
+    static void _copy_fields(grid_set<dim, T...>& dst,
+                             grid_set<dim, T...>& src,
+                             const halo_overlap<dim>& overlap,
+                             std::index_sequence<I...>)
+    {
+        (void)std::initializer_list<int>{ (
+            dst.template get<I>().copy_halo_from(src.template get<I>(), overlap),
+            0)... };
+    }
+
+    void _build()
+    {
+        const u64 count = subdomain_count();
+        m_grids.clear();
+        m_origins.clear();
+        for (u64 s = 0; s < count; ++s) {
+            const auto coords = _layout_coords(s);
+            std::array<u64, dim> origin, size;
+            for (u32 i = 0; i < dim; ++i) {
+                origin[i] = m_cuts[i][coords[i]];
+                size[i] = m_cuts[i][coords[i] + 1] - origin[i];
+            }
+            m_grids.emplace_back(size, m_halo_size);
+            m_origins.push_back(origin);
+        }
+
+        m_neighbors.assign(count, std::vector<neighbor>());
+        for (u64 s = 0; s < count; ++s) {
+            for (u64 t = 0; t < count; ++t) {
+                if (s == t) {
+                    continue;
+                }
+                auto overlap = m_grids[s].template get<0>().find_halo_overlap(
+                    m_grids[t].template get<0>(),
+                    _to_signed(m_origins[s]),
+                    _to_signed(m_origins[t]));
+                if (!overlap.empty()) {
+                    m_neighbors[s].push_back({ t, overlap });
+                }
+            }
+        }
+        m_times.assign(count, 0.0);
+    }
+
+    std::vector<u64> _balanced_cuts(u32 d) const
+    {
+        const u64 parts = m_layout[d];
+        const std::vector<u64>& old_cuts = m_cuts[d];
+        std::vector<double> cost(parts, 0.0);
+        double total = 0;
+        for (u64 s = 0; s < subdomain_count(); ++s) {
+            cost[_layout_coords(s)[d]] += m_times[s];
+            total += m_times[s];
+        }
+        const u64 min_width = std::max<u64>(1, m_halo_size);
+        if (total <= 0 || parts * min_width > m_size[d]) {
+            return old_cuts;
+        }
+
+        // Assume the cost is uniform inside each slab and cut the axis at
+        // equal fractions of the cumulative cost.
+        std::vector<u64> cuts(parts + 1);
+        cuts[0] = 0;
+        cuts[parts] = m_size[d];
+        double sum = 0;
+        u64 k = 0;
+        for (u64 j = 1; j < parts; ++j) {
+            const double target = total * j / parts;
+            while (k < parts && sum + cost[k] < target) {
+                sum += cost[k];
+                ++k;
+            }
+            double position = old_cuts[k];
+            if (k < parts && cost[k] > 0) {
+                position += (target - sum) / cost[k] *
+                            (old_cuts[k + 1] - old_cuts[k]);
+            }
+            cuts[j] = std::llround(position);
+        }
+
+        for (u64 j = 1; j < parts; ++j) {
+            cuts[j] = std::max(cuts[j], cuts[j - 1] + min_width);
+        }
+        for (u64 j = parts - 1; j > 0; --j) {
+            cuts[j] = std::min(cuts[j], cuts[j + 1] - min_width);
+        }
+        return cuts;
+    }
+
+public:
+    decomposed_grid(const std::array<u64, dim>& size,
+                    u32 halo_size,
+                    u64 workers)
+        : m_size(size)
+        , m_halo_size(halo_size)
+        , m_layout(choose_layout<dim>(size, workers))
+        , m_cuts(_init_cuts(size, m_layout))
+    {
+        _build();
+    }
+
+    const std::array<u64, dim>& size() const { return m_size; }
+    u32 halo_size() const { return m_halo_size; }
+    const std::array<u64, dim>& layout() const { return m_layout; }
+
+    u64 subdomain_count() const
+    {
+        u64 result = 1;
+        for (u32 i = 0; i < dim; ++i) {
+            result *= m_layout[i];
+        }
+        return result;
+    }
+
+    const std::array<u64, dim>& origin(u64 index) const
+    {
+        return m_origins[index];
+    }
+
+    const std::array<u64, dim>& subdomain_size(u64 index) const
+    {
+        return m_grids[index].template get<0>().size();
+    }
+
+    const std::vector<neighbor>& neighbors(u64 index) const
+    {
+        return m_neighbors[index];
+    }
+
+    const std::vector<double>& times() const { return m_times; }
+
+    grid_set<dim, T...>& get(u64 index) { return m_grids[index]; }
+
+    template<u32 i, typename V>
+    void fill(const V& value)
+    {
+        for (auto& grids : m_grids) {
+            grids.template get<i>().fill(value);
+        }
+    }
+
+    template<u32 i>
+    void exchange_halo(u64 index)
+    {
+        auto& dst = m_grids[index].template get<i>();
+        for (const neighbor& n : m_neighbors[index]) {
+            dst.copy_halo_from(m_grids[n.index].template get<i>(), n.overlap);
+        }
+    }
+
+    template<u32 i>
+    void exchange_halo()
+    {
+        for (u64 s = 0; s < subdomain_count(); ++s) {
+            exchange_halo<i>(s);
+        }
+    }
+
+    // Calls func(global_coords, accessor) on every cell of one subdomain. The
+    // accessor is built from the fields selected by indices, in that order.
+    template<u32 rad, u32... indices, typename Func>
+    void iterate_subdomain(u64 index, const Func& func)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const std::array<u64, dim>& origin = m_origins[index];
+        m_grids[index].template subset<indices...>().template iterate<rad>(
+            [&](const std::array<u64, dim>& it, auto& acc) {
+                func(origin + it, acc);
+            });
+        add_time(index, std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+    }
+
+    template<u32 rad, u32... indices, typename Func>
+    void iterate(const Func& func)
+    {
+        for (u64 s = 0; s < subdomain_count(); ++s) {
+            iterate_subdomain<rad, indices...>(s, func);
+        }
+    }
+
+    // Moves the cuts between subdomains so that the time measured by
+    // iterate_subdomain since the last rebalance is evenly distributed. The
+    // contents of all fields are carried over, except for the halo cells on
+    // the boundary of the global domain, which have to be set again.
+    void rebalance()
+    {
+        std::array<std::vector<u64>, dim> cuts;
+        for (u32 d = 0; d < dim; ++d) {
+            cuts[d] = _balanced_cuts(d);
+        }
+        if (cuts == m_cuts) {
+            reset_times();
+            return;
+        }
+        m_cuts = cuts;
+
+        auto old_grids = std::move(m_grids);
+        auto old_origins = std::move(m_origins);
+        _build();
+
+        for (u64 s = 0; s < subdomain_count(); ++s) {
+            for (u64 t = 0; t < old_grids.size(); ++t) {
+                auto overlap = m_grids[s].template get<0>().find_halo_overlap(
+                    old_grids[t].template get<0>(),
+                    _to_signed(m_origins[s]),
+                    _to_signed(old_origins[t]));
+                if (overlap.empty()) {
+                    continue;
+                }
+                _copy_fields(m_grids[s],
+                             old_grids[t],
+                             overlap,
+                             std::index_sequence_for<T...>());
+            }
+        }
+    }
+
+    // Accounts work done on a subdomain outside of iterate_subdomain.
+    void add_time(u64 index, double seconds) { m_times[index] += seconds; }
+
+    void reset_times() { m_times.assign(m_times.size(), 0.0); }
+};
+}
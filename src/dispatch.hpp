@@ -0,0 +1,165 @@
+#pragma once
+
+#include <util.hpp>
+
+// Runtime selection between kernels compiled for different x86 instruction
+// sets, so that a binary built for the baseline ISA still uses AVX2 or
+// AVX-512 where the CPU has it. dispatched(func) runs func inside a wrapper
+// compiled for the selected ISA; the wrapper is flattened, so everything func
+// calls (iterate, the accessor, the kernel itself) is inlined into it and
+// compiled for that ISA too. Code the compiler can't inline, like OpenMP
+// parallel regions, stays baseline: put the dispatch inside them.
+//
+// Only loops the compiler vectorizes gain anything. The row loops of
+// algebra.hpp do; the loops of iterate and its relatives currently don't,
+// so their variants compile to nearly the same code as the baseline.
+//
+// Define STENCIL_DISPATCH (in every translation unit, or with the CMake
+// option of the same name) to make the iterate functions, stencil_operator
+// and the operations of algebra.hpp dispatch on their own.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STENCIL_ISA_VARIANTS
+#endif
+
+namespace stencil {
+
+// Ordered: each one includes the ones before it.
+enum class isa
+{
+    baseline,
+    avx2,
+    avx512
+};
+
+inline isa _detect_isa()
+{
+#ifdef STENCIL_ISA_VARIANTS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma")) {
+        return isa::avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return isa::avx2;
+    }
+#endif
+    return isa::baseline;
+}
+
+// The best instruction set both the CPU and the compiler support.
+inline isa supported_isa()
+{
+    static const isa supported = _detect_isa();
+    return supported;
+}
+
+inline isa& _selected_isa()
+{
+    static isa selected = supported_isa();
+    return selected;
+}
+
+inline isa selected_isa()
+{
+    return _selected_isa();
+}
+
+// Restricts the kernels to an older instruction set, e.g. to compare the
+// variants. Requests beyond supported_isa() are capped. Must not be called
+// while kernels are running.
+inline void select_isa(isa target)
+{
+    _selected_isa() = target < supported_isa() ? target : supported_isa();
+}
+
+using dispatch_hook = void (*)(isa);
+
+inline dispatch_hook& _dispatch_hook()
+{
+    static dispatch_hook hook = nullptr;
+    return hook;
+}
+
+// Installs a function called with the variant of each dispatched call before
+// it runs, e.g. for tests. May be called from several threads at once. Pass
+// nullptr to remove it. Must not be called while kernels are running.
+inline void set_dispatch_hook(dispatch_hook hook)
+{
+    _dispatch_hook() = hook;
+}
+
+inline void _notify_dispatch(isa variant)
+{
+    if (_dispatch_hook()) {
+        _dispatch_hook()(variant);
+    }
+}
+
+#ifdef STENCIL_ISA_VARIANTS
+template<typename Func>
+__attribute__((target("avx2,fma"), flatten)) void _run_avx2(const Func& func)
+{
+    _notify_dispatch(isa::avx2);
+    func();
+}
+
+template<typename Func>
+__attribute__((target("avx512f,avx2,fma"), flatten)) void _run_avx512(
+    const Func& func)
+{
+    _notify_dispatch(isa::avx512);
+    func();
+}
+#endif
+
+// Runs func compiled for target, which must be supported. Loops that dispatch
+// every iteration read selected_isa() once and pass it here.
+template<typename Func>
+void dispatched(isa target, const Func& func)
+{
+#ifdef STENCIL_ISA_VARIANTS
+    switch (target) {
+        case isa::avx512:
+            _run_avx512(func);
+            return;
+        case isa::avx2:
+            _run_avx2(func);
+            return;
+        case isa::baseline:
+            break;
+    }
+#else
+    (void)target;
+#endif
+    _notify_dispatch(isa::baseline);
+    func();
+}
+
+template<typename Func>
+void dispatched(const Func& func)
+{
+    dispatched(selected_isa(), func);
+}
+
+// Dispatches with STENCIL_DISPATCH defined, calls func as it is otherwise.
+template<typename Func>
+inline void _maybe_dispatched(const Func& func)
+{
+#ifdef STENCIL_DISPATCH
+    dispatched(func);
+#else
+    func();
+#endif
+}
+
+template<typename Func>
+inline void _maybe_dispatched(isa target, const Func& func)
+{
+#ifdef STENCIL_DISPATCH
+    dispatched(target, func);
+#else
+    (void)target;
+    func();
+#endif
+}
+}
@@ -0,0 +1,706 @@
+#pragma once
+
+#include <algorithm>
+#include <buffer.hpp>
+#include <cassert>
+#include <functional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace stencil {
+
+// Expression templates for stencils. An expression is a tree of field reads at
+// compile-time offsets, so its radius is known exactly and every read turns
+// into a constant offset into the accessor's table. Reads of the same cell at
+// the same offset are identical loads, which the compiler merges.
+//
+//     auto u = field<0>();
+//     auto step = assign<1>(u + 0.2 * laplace(u));
+//     apply(step, grid0, grid1);
+
+template<i64... o>
+struct offset
+{
+    static constexpr u32 size = sizeof...(o);
+
+    static constexpr u32 radius()
+    {
+        i64 result = 0;
+        for (i64 x : { i64(0), o... }) {
+            result = std::max(result, x < 0 ? -x : x);
+        }
+        return result;
+    }
+};
+
+template<typename A, typename B>
+struct _offset_sum;
+
+template<i64... a, i64... b>
+struct _offset_sum<offset<a...>, offset<b...>>
+{
+    static_assert(sizeof...(a) == sizeof...(b),
+                  "offset doesn't match the dimension of the grid");
+    using type = offset<(a + b)...>;
+};
+
+template<u32 d, i64 v, typename Off, typename Seq>
+struct _offset_add_impl;
+
+template<u32 d, i64 v, i64... o, std::size_t... I>
+struct _offset_add_impl<d, v, offset<o...>, std::index_sequence<I...>>
+{
+    using type = offset<(o + (I == d ? v : 0))...>;
+};
+
+// Adds v to the d-th component of Off.
+template<u32 d, i64 v, typename Off>
+struct _offset_add;
+
+template<u32 d, i64 v, i64... o>
+struct _offset_add<d, v, offset<o...>>
+{
+    using type = typename _offset_add_impl<d,
+                                           v,
+                                           offset<o...>,
+                                           std::make_index_sequence<sizeof...(
+                                               o)>>::type;
+};
+
+template<typename Seq>
+struct _zero_offset_impl;
+
+template<std::size_t... I>
+struct _zero_offset_impl<std::index_sequence<I...>>
+{
+    using type = offset<(static_cast<i64>(I) * 0)...>;
+};
+
+template<u32 dim>
+using zero_offset =
+    typename _zero_offset_impl<std::make_index_sequence<dim>>::type;
+
+template<i64... o>
+constexpr std::array<i64, sizeof...(o)> _to_array(offset<o...>)
+{
+    return { { o... } };
+}
+
+template<typename E>
+struct expression
+{
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+template<u32 i>
+struct field_expr : expression<field_expr<i>>
+{
+    static constexpr u32 radius = 0;
+
+    template<u32 j>
+    static constexpr bool reads()
+    {
+        return j == i;
+    }
+
+    template<typename Off, typename Ctx>
+    auto eval(const Ctx& ctx) const
+    {
+        return ctx.template load<i, Off>();
+    }
+};
+
+template<typename V>
+struct scalar_expr : expression<scalar_expr<V>>
+{
+    static constexpr u32 radius = 0;
+    V value;
+
+    template<u32 j>
+    static constexpr bool reads()
+    {
+        return false;
+    }
+
+    scalar_expr(V value)
+        : value(value)
+    {}
+
+    template<typename Off, typename Ctx>
+    V eval(const Ctx&) const
+    {
+        return value;
+    }
+};
+
+template<typename E, i64... o>
+struct shift_expr : expression<shift_expr<E, o...>>
+{
+    static constexpr u32 radius = E::radius + offset<o...>::radius();
+    E expr;
+
+    template<u32 j>
+    static constexpr bool reads()
+    {
+        return E::template reads<j>();
+    }
+
+    shift_expr(const E& expr)
+        : expr(expr)
+    {}
+
+    template<typename Off, typename Ctx>
+    auto eval(const Ctx& ctx) const
+    {
+        return expr.template eval<
+            typename _offset_sum<Off, offset<o...>>::type>(ctx);
+    }
+};
+
+template<typename E>
+struct laplace_expr : expression<laplace_expr<E>>
+{
+    static constexpr u32 radius = E::radius + 1;
+    E expr;
+
+    template<u32 j>
+    static constexpr bool reads()
+    {
+        return E::template reads<j>();
+    }
+
+    laplace_expr(const E& expr)
+        : expr(expr)
+    {}
+
+    template<typename Off, typename Ctx, u32 d>
+    auto _sum(const Ctx& ctx, std::integral_constant<u32, d>) const
+    {
+        return expr.template eval<typename _offset_add<d, -1, Off>::type>(
+                   ctx) +
+               expr.template eval<typename _offset_add<d, 1, Off>::type>(ctx) +
+               _sum<Off>(ctx, std::integral_constant<u32, d - 1>());
+    }
+
+    template<typename Off, typename Ctx>
+    auto _sum(const Ctx& ctx, std::integral_constant<u32, 0>) const
+    {
+        return expr.template eval<typename _offset_add<0, -1, Off>::type>(
+                   ctx) +
+               expr.template eval<typename _offset_add<0, 1, Off>::type>(ctx);
+    }
+
+    template<typename Off, typename Ctx>
+    auto eval(const Ctx& ctx) const
+    {
+        return _sum<Off>(ctx, std::integral_constant<u32, Off::size - 1>()) -
+               static_cast<i64>(2 * Off::size) * expr.template eval<Off>(ctx);
+    }
+};
+
+template<typename L, typename R, typename Op>
+struct binary_expr : expression<binary_expr<L, R, Op>>
+{
+    static constexpr u32 radius = L::radius > R::radius ? L::radius : R::radius;
+    L left;
+    R right;
+
+    template<u32 j>
+    static constexpr bool reads()
+    {
+        return L::template reads<j>() || R::template reads<j>();
+    }
+
+    binary_expr(const L& left, const R& right)
+        : left(left)
+        , right(right)
+    {}
+
+    template<typename Off, typename Ctx>
+    auto eval(const Ctx& ctx) const
+    {
+        return Op()(left.template eval<Off>(ctx),
+                    right.template eval<Off>(ctx));
+    }
+};
+
+template<typename E>
+struct negate_expr : expression<negate_expr<E>>
+{
+    static constexpr u32 radius = E::radius;
+    E expr;
+
+    template<u32 j>
+    static constexpr bool reads()
+    {
+        return E::template reads<j>();
+    }
+
+    negate_expr(const E& expr)
+        : expr(expr)
+    {}
+
+    template<typename Off, typename Ctx>
+    auto eval(const Ctx& ctx) const
+    {
+        return -expr.template eval<Off>(ctx);
+    }
+};
+
+template<u32 i>
+field_expr<i> field()
+{
+    return field_expr<i>();
+}
+
+template<i64... o, typename E>
+shift_expr<E, o...> shift(const expression<E>& expr)
+{
+    return shift_expr<E, o...>(expr.self());
+}
+
+template<typename E>
+laplace_expr<E> laplace(const expression<E>& expr)
+{
+    return laplace_expr<E>(expr.self());
+}
+
+template<typename E>
+negate_expr<E> operator-(const expression<E>& expr)
+{
+    return negate_expr<E>(expr.self());
+}
+
+#define STENCIL_EXPRESSION_OPERATOR(op, functor)                               \
+    template<typename L, typename R>                                           \
+    binary_expr<L, R, functor> operator op(const expression<L>& left,          \
+                                           const expression<R>& right)         \
+    {                                                                          \
+        return binary_expr<L, R, functor>(left.self(), right.self());          \
+    }                                                                          \
+                                                                               \
+    template<typename L,                                                       \
+             typename V,                                                       \
+             typename = std::enable_if_t<std::is_arithmetic<V>::value>>        \
+    binary_expr<L, scalar_expr<V>, functor> operator op(                       \
+        const expression<L>& left, V right)                                    \
+    {                                                                          \
+        return binary_expr<L, scalar_expr<V>, functor>(left.self(), right);    \
+    }                                                                          \
+                                                                               \
+    template<typename V,                                                       \
+             typename R,                                                       \
+             typename = std::enable_if_t<std::is_arithmetic<V>::value>>        \
+    binary_expr<scalar_expr<V>, R, functor> operator op(                       \
+        V left, const expression<R>& right)                                    \
+    {                                                                          \
+        return binary_expr<scalar_expr<V>, R, functor>(left, right.self());    \
+    }
+
+STENCIL_EXPRESSION_OPERATOR(+, std::plus<>)
+STENCIL_EXPRESSION_OPERATOR(-, std::minus<>)
+STENCIL_EXPRESSION_OPERATOR(*, std::multiplies<>)
+STENCIL_EXPRESSION_OPERATOR(/, std::divides<>)
+
+#undef STENCIL_EXPRESSION_OPERATOR
+
+// Writes the value of an expression into field `target` of the current cell.
+template<u32 target, typename E>
+struct stage
+{
+    static constexpr u32 output = target;
+    static constexpr u32 radius = E::radius;
+    E expr;
+
+    template<u32 i>
+    static constexpr bool writes()
+    {
+        return i == target;
+    }
+
+    template<u32 i>
+    static constexpr bool reads()
+    {
+        return E::template reads<i>();
+    }
+
+    template<u32 i>
+    static constexpr bool clobbers()
+    {
+        return false;
+    }
+
+    template<typename Off, typename Ctx>
+    auto eval(const Ctx& ctx) const
+    {
+        return expr.template eval<Off>(ctx);
+    }
+
+    // The value this stage writes to field i, which has to be its output.
+    template<u32 i, typename Off, typename Ctx>
+    auto eval_field(const Ctx& ctx) const
+    {
+        return eval<Off>(ctx);
+    }
+};
+
+// Two consecutive stages computed in a single sweep: reads in second of any
+// field written by first (or by the stages fused into first) are replaced by
+// the expression that wrote it, at the same offset, so the intermediate
+// fields are never written.
+//
+// Evaluated cell by cell, as kernel() does, nothing is shared between
+// neighbouring cells: first is recomputed at every offset second reads it
+// at, e.g. fuse(assign<1>(laplace(u)), assign<2>(laplace(field<1>()))) costs
+// five laplacians per cell. apply() avoids that for two plain stages by
+// buffering first's output, see _apply.
+template<typename First, typename Second>
+struct fused_stage
+{
+    static constexpr u32 output = Second::output;
+    static constexpr u32 radius = First::radius + Second::radius;
+    First first;
+    Second second;
+
+    template<typename Ctx>
+    struct substitution
+    {
+        const First& first;
+        const Ctx& ctx;
+
+        template<u32 i, typename Off>
+        auto _load(std::true_type) const
+        {
+            return first.template eval_field<i, Off>(ctx);
+        }
+
+        template<u32 i, typename Off>
+        auto _load(std::false_type) const
+        {
+            return ctx.template load<i, Off>();
+        }
+
+        template<u32 i, typename Off>
+        auto load() const
+        {
+            return _load<i, Off>(std::integral_constant<
+                                 bool,
+                                 First::template writes<i>()>());
+        }
+    };
+
+    template<u32 i>
+    static constexpr bool writes()
+    {
+        return First::template writes<i>() || Second::template writes<i>();
+    }
+
+    // Reads of field i by second that aren't substituted by first.
+    template<u32 i>
+    static constexpr bool reads()
+    {
+        return First::template reads<i>() ||
+               (Second::template reads<i>() && !First::template writes<i>());
+    }
+
+    // Whether a later stage overwrites field i while an earlier one reads it.
+    // Computed in a single sweep, the earlier stage would then see the new
+    // values at neighbouring cells which were already done.
+    template<u32 i>
+    static constexpr bool clobbers()
+    {
+        return First::template clobbers<i>() ||
+               Second::template clobbers<i>() ||
+               (First::template reads<i>() && Second::template writes<i>());
+    }
+
+    template<u32 i, typename Off, typename Ctx>
+    auto _eval_field(const Ctx& ctx, std::true_type) const
+    {
+        return second.template eval_field<i, Off>(
+            substitution<Ctx>{ first, ctx });
+    }
+
+    template<u32 i, typename Off, typename Ctx>
+    auto _eval_field(const Ctx& ctx, std::false_type) const
+    {
+        return first.template eval_field<i, Off>(ctx);
+    }
+
+    // The last value the fused stages write to field i.
+    template<u32 i, typename Off, typename Ctx>
+    auto eval_field(const Ctx& ctx) const
+    {
+        return _eval_field<i, Off>(
+            ctx,
+            std::integral_constant<bool, Second::template writes<i>()>());
+    }
+
+    template<typename Off, typename Ctx>
+    auto eval(const Ctx& ctx) const
+    {
+        return eval_field<output, Off>(ctx);
+    }
+};
+
+template<u32 target, typename E>
+stage<target, E> assign(const expression<E>& expr)
+{
+    return { expr.self() };
+}
+
+template<typename First, typename Second>
+fused_stage<First, Second> fuse(const First& first, const Second& second)
+{
+    return { first, second };
+}
+
+template<typename First, typename Second, typename... Rest>
+auto fuse(const First& first, const Second& second, const Rest&... rest)
+{
+    return fuse(fuse(first, second), rest...);
+}
+
+template<u32 rad, u32 dim, typename... T>
+struct _accessor_context
+{
+    accessor<rad, dim, T...>& acc;
+
+    template<u32 i, typename Off>
+    typename accessor<rad, dim, T...>::template value_type<i> load() const
+    {
+        static_assert(Off::radius() <= rad, "read outside of the stencil");
+        return acc.template get<i>(_to_array(Off()));
+    }
+};
+
+template<typename S, u32 rad, u32 dim, typename... T>
+inline void _run_stage(const S& s, accessor<rad, dim, T...>& acc)
+{
+    const _accessor_context<rad, dim, T...> ctx{ acc };
+    acc.template get<S::output>(repeat<i64, dim>(0)) =
+        s.template eval<zero_offset<dim>>(ctx);
+}
+
+// Turns a stage into a callable for iterate and its relatives. The radius of
+// the iteration has to be at least S::radius.
+template<typename S>
+auto kernel(const S& s)
+{
+    return [s](const auto&, auto& acc) {
+        _run_stage(s, acc);
+    };
+}
+
+template<typename S, u32 dim, typename... T>
+void _apply(const S& s, grid<dim, T>&... grids)
+{
+    iterate<S::radius>(kernel(s), grids...);
+}
+
+template<u32 rad, typename Func, u32 dim, typename... T, std::size_t... I>
+void _iterate_tuple(const Func& func,
+                    std::tuple<grid<dim, T>...>& grids,
+                    std::index_sequence<I...>)
+{
+    iterate<rad>(func, std::get<I>(grids)...);
+}
+
+// Reads of the first stage's output come from a buffer holding its values
+// around the current cell.
+template<u32 buffered, typename V, u32 dim, typename Ctx>
+struct _buffered_context
+{
+    const Ctx& ctx;
+    const V* center;
+    const std::array<u64, dim> stride;
+
+    template<i64... o>
+    static i64 _index(offset<o...>, const std::array<u64, dim>& stride)
+    {
+        const std::array<i64, dim> off = { { o... } };
+        i64 result = 0;
+        for (u32 i = 0; i < dim; ++i) {
+            result += off[i] * static_cast<i64>(stride[i]);
+        }
+        return result;
+    }
+
+    template<u32 i, typename Off>
+    V _load(std::true_type) const
+    {
+        return center[_index(Off(), stride)];
+    }
+
+    template<u32 i, typename Off>
+    auto _load(std::false_type) const
+    {
+        return ctx.template load<i, Off>();
+    }
+
+    template<u32 i, typename Off>
+    auto load() const
+    {
+        return _load<i, Off>(std::integral_constant<bool, i == buffered>());
+    }
+};
+
+// Target number of cells in a slab of a buffered fusion.
+constexpr u64 _fusion_slab_cells = 1 << 15;
+
+// Two plain stages are computed slab by slab along the last dimension: first
+// is written to a small buffer covering the slab and second's radius around
+// it, which second then reads. Only the 2 * radius layers shared by
+// neighbouring slabs are computed twice.
+template<u32 target, typename E, typename Second, u32 dim, typename... T>
+void _apply(const fused_stage<stage<target, E>, Second>& s,
+            grid<dim, T>&... grids)
+{
+    using first_type = stage<target, E>;
+    using V = typename field_traits<typename std::tuple_element<
+        target,
+        std::tuple<T...>>::type>::value_type;
+    constexpr u32 r1 = first_type::radius;
+    constexpr u32 r2 = Second::radius;
+    const std::array<i64, dim> zero = repeat<i64, dim>(0);
+    const std::array<u64, dim> size = std::get<0>(std::tie(grids...)).size();
+
+    u64 cross_section = 1;
+    for (u32 i = 0; i + 1 < dim; ++i) {
+        cross_section *= size[i] + 2 * r2;
+    }
+    const u64 thickness =
+        std::min(size[dim - 1],
+                 std::max<u64>(std::max<u32>(4 * r2, 1),
+                               _fusion_slab_cells / cross_section));
+    std::array<u64, dim> slab_size = size;
+    slab_size[dim - 1] = thickness;
+    grid<dim, V> scratch(slab_size, r2);
+    const std::array<u64, dim> stride = scratch.stride();
+    V* const origin = &scratch.get_raw(repeat<u64, dim>(0));
+    auto index = [stride](const std::array<u64, dim>& coords) {
+        u64 result = 0;
+        for (u32 i = 0; i < dim; ++i) {
+            result += coords[i] * stride[i];
+        }
+        return result;
+    };
+
+    for (u64 from = 0; from < size[dim - 1]; from += thickness) {
+        std::array<u64, dim> slab_from = repeat<u64, dim>(0);
+        slab_from[dim - 1] = from;
+        slab_size[dim - 1] = std::min(thickness, size[dim - 1] - from);
+
+        auto extended = std::make_tuple(
+            grids.view(slab_from, slab_size, r2).raw_view(r1)...);
+        _iterate_tuple<r1>(
+            [&](const std::array<u64, dim>& it, auto& acc) {
+                const _accessor_context<r1, dim, T...> ctx{ acc };
+                origin[index(it)] =
+                    s.first.template eval<zero_offset<dim>>(ctx);
+            },
+            extended,
+            std::index_sequence_for<T...>());
+
+        auto slab = std::make_tuple(grids.view(slab_from, slab_size, r2)...);
+        _iterate_tuple<r2>(
+            [&](const std::array<u64, dim>& it, auto& acc) {
+                const _accessor_context<r2, dim, T...> inner{ acc };
+                const V* center = origin + index(it + repeat<u64, dim>(r2));
+                const _buffered_context<target,
+                                        V,
+                                        dim,
+                                        _accessor_context<r2, dim, T...>>
+                    ctx{ inner, center, stride };
+                acc.template get<Second::output>(zero) =
+                    s.second.template eval<zero_offset<dim>>(ctx);
+            },
+            slab,
+            std::index_sequence_for<T...>());
+    }
+}
+
+template<typename S>
+constexpr bool _clobbers_any(std::index_sequence<>)
+{
+    return false;
+}
+
+template<typename S, std::size_t i, std::size_t... rest>
+constexpr bool _clobbers_any(std::index_sequence<i, rest...>)
+{
+    return S::template clobbers<i>() ||
+           _clobbers_any<S>(std::index_sequence<rest...>());
+}
+
+template<typename S, u32 dim, typename... T>
+void _apply_checked(const S& s, std::false_type, grid<dim, T>&... grids)
+{
+    _apply(s, grids...);
+}
+
+// Fused stages that clobber their own input run one sweep per stage instead.
+template<typename S, u32 dim, typename... T>
+void _apply_checked(const S& s, std::true_type, grid<dim, T>&... grids)
+{
+    _apply(s, grids...);
+}
+
+template<typename First, typename Second, u32 dim, typename... T>
+void _apply_checked(const fused_stage<First, Second>& s,
+                    std::true_type,
+                    grid<dim, T>&... grids)
+{
+    _apply_checked(s.first, std::true_type(), grids...);
+    _apply_checked(s.second, std::true_type(), grids...);
+}
+
+template<typename S, typename... T>
+using _clobbers = std::integral_constant<
+    bool,
+    _clobbers_any<S>(std::index_sequence_for<T...>())>;
+
+// Throws std::invalid_argument if a grid's halo is narrower than the radius
+// of the stage.
+template<typename S, u32 dim, typename... T>
+void apply(const S& s, grid<dim, T>&... grids)
+{
+    for (u32 halo : { grids.halo_size()... }) {
+        if (S::radius > halo) {
+            throw std::invalid_argument(
+                "apply: the halo is narrower than the stage's radius");
+        }
+    }
+    _apply_checked(s, _clobbers<S, T...>(), grids...);
+}
+
+template<typename S, u32 dim, typename... T>
+void _apply_periodic(const S& s, std::false_type, grid<dim, T>&... grids)
+{
+    iterate_periodic<S::radius>(kernel(s), grids...);
+}
+
+template<typename S, u32 dim, typename... T>
+void _apply_periodic(const S& s, std::true_type, grid<dim, T>&... grids)
+{
+    iterate_periodic<S::radius>(kernel(s), grids...);
+}
+
+template<typename First, typename Second, u32 dim, typename... T>
+void _apply_periodic(const fused_stage<First, Second>& s,
+                     std::true_type,
+                     grid<dim, T>&... grids)
+{
+    _apply_periodic(s.first, std::true_type(), grids...);
+    _apply_periodic(s.second, std::true_type(), grids...);
+}
+
+// apply on periodic grids, which need no halo.
+template<typename S, u32 dim, typename... T>
+void apply_periodic(const S& s, grid<dim, T>&... grids)
+{
+    _apply_periodic(s, _clobbers<S, T...>(), grids...);
+}
+}
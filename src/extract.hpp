@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <buffer.hpp>
+#include <cassert>
+#include <vector>
+
+namespace stencil {
+
+// Packed 2D image, pixel (x, y) is stored at data()[y * width() + x].
+template<typename T>
+class image
+{
+    u64 m_width, m_height;
+    std::vector<T> m_data;
+
+public:
+    image()
+        : m_width(0)
+        , m_height(0)
+    {}
+
+    image(u64 width, u64 height)
+        : m_width(width)
+        , m_height(height)
+        , m_data(width * height)
+    {}
+
+    // Keeps the allocation when the size doesn't change, so an image can be
+    // reused from frame to frame.
+    void resize(u64 width, u64 height)
+    {
+        m_width = width;
+        m_height = height;
+        m_data.resize(width * height);
+    }
+
+    u64 width() const { return m_width; }
+    u64 height() const { return m_height; }
+
+    T& operator()(u64 x, u64 y) { return m_data[y * m_width + x]; }
+    const T& operator()(u64 x, u64 y) const { return m_data[y * m_width + x]; }
+
+    T* data() { return m_data.data(); }
+    const T* data() const { return m_data.data(); }
+};
+
+struct rgba8
+{
+    u8 r, g, b, a;
+};
+
+inline bool operator==(const rgba8& x, const rgba8& y)
+{
+    return x.r == y.r && x.g == y.g && x.b == y.b && x.a == y.a;
+}
+
+// Maps [lo, hi] linearly onto a gradient between evenly spaced colors. The
+// gradient is sampled into a lookup table once, so mapping a value is a
+// multiplication and a load.
+class colormap
+{
+    static constexpr u32 _table_size = 256;
+    std::vector<rgba8> m_table;
+    double m_lo, m_scale;
+
+public:
+    colormap(const std::vector<rgba8>& colors, double lo, double hi)
+        : m_table(_table_size)
+        , m_lo(lo)
+        , m_scale(hi > lo ? (_table_size - 1) / (hi - lo) : 0)
+    {
+        assert(colors.size() >= 2);
+        const u64 segments = colors.size() - 1;
+        for (u32 i = 0; i < _table_size; ++i) {
+            const double t = double(i) * segments / (_table_size - 1);
+            const u64 k = std::min<u64>(static_cast<u64>(t), segments - 1);
+            const double w = t - k;
+            const rgba8& a = colors[k];
+            const rgba8& b = colors[k + 1];
+            auto mix = [w](u8 x, u8 y) {
+                return static_cast<u8>(x + (double(y) - x) * w + 0.5);
+            };
+            m_table[i] = { mix(a.r, b.r), mix(a.g, b.g), mix(a.b, b.b),
+                           mix(a.a, b.a) };
+        }
+    }
+
+    static colormap grayscale(double lo, double hi)
+    {
+        return colormap({ { 0, 0, 0, 255 }, { 255, 255, 255, 255 } }, lo, hi);
+    }
+
+    // black - red - yellow - white
+    static colormap heat(double lo, double hi)
+    {
+        return colormap({ { 0, 0, 0, 255 },
+                          { 255, 0, 0, 255 },
+                          { 255, 255, 0, 255 },
+                          { 255, 255, 255, 255 } },
+                        lo,
+                        hi);
+    }
+
+    rgba8 operator()(double value) const
+    {
+        const double t = (value - m_lo) * m_scale;
+        if (!(t > 0)) {
+            return m_table.front();
+        }
+        if (t >= _table_size - 1) {
+            return m_table.back();
+        }
+        return m_table[static_cast<u32>(t + 0.5)];
+    }
+};
+
+enum class pooling
+{
+    min,
+    max,
+    avg
+};
+
+// A 2D plane of a grid: axes x and y span the plane, the coordinates of the
+// other dimensions are taken from position. Every factor x factor block of
+// cells in the plane is reduced to a single pixel.
+template<u32 dim>
+struct slice
+{
+    u32 x_axis, y_axis;
+    std::array<u64, dim> position;
+    u64 factor;
+    pooling mode;
+
+    slice(u32 x_axis, u32 y_axis)
+        : x_axis(x_axis)
+        , y_axis(y_axis)
+        , position(repeat<u64, dim>(0))
+        , factor(1)
+        , mode(pooling::avg)
+    {}
+
+    slice(u32 x_axis,
+          u32 y_axis,
+          const std::array<u64, dim>& position,
+          u64 factor = 1,
+          pooling mode = pooling::avg)
+        : x_axis(x_axis)
+        , y_axis(y_axis)
+        , position(position)
+        , factor(factor)
+        , mode(mode)
+    {}
+};
+
+// Folds a row of values into the row accumulated so far.
+template<typename V>
+inline void _pool_row(pooling mode, const V* row, u64 width, V* result)
+{
+    switch (mode) {
+        case pooling::min:
+            for (u64 x = 0; x < width; ++x) {
+                result[x] = std::min(result[x], row[x]);
+            }
+            break;
+        case pooling::max:
+            for (u64 x = 0; x < width; ++x) {
+                result[x] = std::max(result[x], row[x]);
+            }
+            break;
+        case pooling::avg:
+            for (u64 x = 0; x < width; ++x) {
+                result[x] += row[x];
+            }
+            break;
+    }
+}
+
+// Reduces a slice of g to an image of width x height pixels and stores
+// emit(value) for each of them. Rows of the image are processed in parallel.
+template<u32 dim, typename T, typename P, typename Emit>
+void _extract_impl(const grid<dim, T>& g,
+                   const slice<dim>& s,
+                   image<P>& out,
+                   const Emit& emit)
+{
+    using V = typename grid<dim, T>::value_type;
+    assert(s.x_axis < dim && s.y_axis < dim && s.x_axis != s.y_axis);
+    assert(s.factor > 0);
+    const u64 factor = s.factor;
+    const u64 size_x = g.size()[s.x_axis];
+    const u64 size_y = g.size()[s.y_axis];
+    const u64 width = (size_x + factor - 1) / factor;
+    const u64 height = (size_y + factor - 1) / factor;
+    out.resize(width, height);
+    if (width == 0 || height == 0) {
+        return;
+    }
+
+    std::array<u64, dim> origin = s.position;
+    origin[s.x_axis] = 0;
+    origin[s.y_axis] = 0;
+    const storage_t<T>* base = &g.get(origin);
+    const u64 step_x = g.stride()[s.x_axis];
+    const u64 step_y = g.stride()[s.y_axis];
+    const i64 rows = height;
+
+    STENCIL_OMP(parallel)
+    {
+        std::vector<V> line(size_x), block(size_x);
+        STENCIL_OMP(for schedule(static))
+        for (i64 oy = 0; oy < rows; ++oy) {
+            const u64 y0 = oy * factor;
+            const u64 y1 = std::min(y0 + factor, size_y);
+            // Rows of the block are reduced first, streaming through memory,
+            // and the columns afterwards.
+            for (u64 y = y0; y < y1; ++y) {
+                const storage_t<T>* src = base + y * step_y;
+                V* dst = y == y0 ? block.data() : line.data();
+                for (u64 x = 0; x < size_x; ++x) {
+                    dst[x] = field_traits<T>::ref(src + x * step_x);
+                }
+                if (y != y0) {
+                    _pool_row(s.mode, line.data(), size_x, block.data());
+                }
+            }
+            P* dst = &out(0, oy);
+            for (u64 ox = 0; ox < width; ++ox) {
+                const u64 x0 = ox * factor;
+                const u64 x1 = std::min(x0 + factor, size_x);
+                V value = block[x0];
+                for (u64 x = x0 + 1; x < x1; ++x) {
+                    switch (s.mode) {
+                        case pooling::min:
+                            value = std::min(value, block[x]);
+                            break;
+                        case pooling::max:
+                            value = std::max(value, block[x]);
+                            break;
+                        case pooling::avg:
+                            value += block[x];
+                            break;
+                    }
+                }
+                if (s.mode == pooling::avg) {
+                    value /= static_cast<V>((x1 - x0) * (y1 - y0));
+                }
+                dst[ox] = emit(value);
+            }
+        }
+    }
+}
+
+// Copies (and possibly downsamples) a slice of g into out.
+template<u32 dim, typename T>
+void extract(const grid<dim, T>& g,
+             const slice<dim>& s,
+             image<typename grid<dim, T>::value_type>& out)
+{
+    using V = typename grid<dim, T>::value_type;
+    _extract_impl(g, s, out, [](const V& value) { return value; });
+}
+
+// Same as extract, but colors the pixels on the way, so a frame for display
+// takes a single pass over the grid.
+template<u32 dim, typename T>
+void render(const grid<dim, T>& g,
+            const slice<dim>& s,
+            const colormap& map,
+            image<rgba8>& out)
+{
+    using V = typename grid<dim, T>::value_type;
+    _extract_impl(g, s, out, [&](const V& value) {
+        return map(static_cast<double>(value));
+    });
+}
+}
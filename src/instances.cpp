@@ -0,0 +1,27 @@
+#include <instances.hpp>
+#include <solver.hpp>
+
+namespace stencil {
+#define STENCIL_INSTANTIATE(dim, T)                                            \
+    template class buffer<dim, T>;                                             \
+    template class grid<dim, T>;                                               \
+    template class stencil_operator<dim, 1, T>;                                \
+    template class conjugate_gradient<dim, T>;                                 \
+    template class bicgstab<dim, T>;                                           \
+    template solver_result conjugate_gradient<dim, T>::solve<1>(               \
+        const stencil_operator<dim, 1, T>&,                                    \
+        grid<dim, T>&,                                                         \
+        grid<dim, T>&,                                                         \
+        T,                                                                     \
+        u64);                                                                  \
+    template solver_result bicgstab<dim, T>::solve<1>(                         \
+        const stencil_operator<dim, 1, T>&,                                    \
+        grid<dim, T>&,                                                         \
+        grid<dim, T>&,                                                         \
+        T,                                                                     \
+        u64);
+
+STENCIL_INSTANCES(STENCIL_INSTANTIATE)
+
+#undef STENCIL_INSTANTIATE
+}
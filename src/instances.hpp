@@ -0,0 +1,13 @@
+#pragma once
+
+// The (dim, type) combinations that src/instances.cpp compiles into the
+// stencil library. With STENCIL_EXTERN_TEMPLATES defined, the headers declare
+// them extern, so translation units linking the library don't instantiate
+// them again.
+#define STENCIL_INSTANCES(X)                                                   \
+    X(1, float)                                                                \
+    X(1, double)                                                               \
+    X(2, float)                                                                \
+    X(2, double)                                                               \
+    X(3, float)                                                                \
+    X(3, double)
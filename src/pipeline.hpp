@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <buffer.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace stencil {
+
+template<u32 dim, typename T>
+grid<dim, T> _snapshot_like(const grid<dim, T>& like)
+{
+    return grid<dim, T>(like.size(), like.halo_size());
+}
+
+template<u32 dim, typename... T>
+grid_set<dim, T...> _snapshot_like(const grid_set<dim, T...>& like)
+{
+    const auto& first = like.template get<0>();
+    return grid_set<dim, T...>(first.size(), first.halo_size());
+}
+
+// Copies the whole buffer area of the grid, halo included, so the consumer
+// may read neighbours of the edge cells like it would on the original grid.
+template<u32 dim, typename T>
+void _copy_snapshot(grid<dim, T>& dst, const grid<dim, T>& src)
+{
+    assert(dst.size_with_halo() == src.size_with_halo());
+    std::array<u64, dim> rows = src.size_with_halo();
+    const u64 length = rows[0];
+    rows[0] = 1;
+    loop<dim>(repeat<u64, dim>(0), rows, [&](const std::array<u64, dim>& it) {
+        const auto* row = &src.get_raw(it);
+        std::copy(row, row + length, &dst.get_raw(it));
+    });
+}
+
+template<u32 dim, typename... T, std::size_t... I>
+void _copy_snapshot_impl(grid_set<dim, T...>& dst,
+                         const grid_set<dim, T...>& src,
+                         std::index_sequence<I...>)
+{
+    (void)std::initializer_list<int>{ (
+        _copy_snapshot(dst.template get<I>(), src.template get<I>()), 0)... };
+}
+
+template<u32 dim, typename... T>
+void _copy_snapshot(grid_set<dim, T...>& dst, const grid_set<dim, T...>& src)
+{
+    _copy_snapshot_impl(dst, src, std::index_sequence_for<T...>());
+}
+
+// Hands completed time levels of a grid (or of all fields of a grid_set at
+// once) to a consumer running on its own thread (for output, visualization,
+// analysis...) while the computation goes on. A published level is passed to
+// the consumer as it is; it only gets copied, halo included, into one of the
+// snapshot slots if the computation wants to overwrite it before the consumer
+// got to it. With all slots in use, or with as many levels waiting as there
+// are slots, the computation blocks until the consumer catches up.
+template<typename Data>
+class basic_snapshot_pipeline : not_copyable
+{
+public:
+    using consumer = std::function<void(const Data&, u64)>;
+
+private:
+    struct slot
+    {
+        Data data;
+        bool busy;
+    };
+
+    struct entry
+    {
+        const Data* source;
+        u64 level;
+        i64 slot;
+    };
+
+    consumer m_consumer;
+    std::vector<slot> m_slots;
+    std::deque<entry> m_queue;
+    const Data* m_active;
+    u64 m_copies;
+    bool m_stop;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::thread m_thread;
+
+    void _consume()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_changed.wait(lock, [&] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                return;
+            }
+            const entry current = m_queue.front();
+            m_queue.pop_front();
+            m_active = current.source;
+            m_changed.notify_all();
+            lock.unlock();
+            m_consumer(*current.source, current.level);
+            lock.lock();
+            m_active = nullptr;
+            if (current.slot >= 0) {
+                m_slots[current.slot].busy = false;
+            }
+            m_changed.notify_all();
+        }
+    }
+
+    i64 _free_slot() const
+    {
+        for (u64 i = 0; i < m_slots.size(); ++i) {
+            if (!m_slots[i].busy) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+public:
+    // slots is the number of snapshots (of grids shaped like `like`) that may
+    // be kept at the same time.
+    basic_snapshot_pipeline(const Data& like, u64 slots, consumer func)
+        : m_consumer(std::move(func))
+        , m_active(nullptr)
+        , m_copies(0)
+        , m_stop(false)
+    {
+        for (u64 i = 0; i < std::max<u64>(slots, 1); ++i) {
+            m_slots.push_back({ _snapshot_like(like), false });
+        }
+        m_thread = std::thread([this] { _consume(); });
+    }
+
+    ~basic_snapshot_pipeline()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+    }
+
+    // Queues a completed time level. The grids must stay alive and unmodified
+    // until they are passed to reclaim.
+    void publish(const Data& source, u64 level)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&] { return m_queue.size() < m_slots.size(); });
+        m_queue.push_back({ &source, level, -1 });
+        m_changed.notify_all();
+    }
+
+    // Must be called before overwriting a published grid. Waits while the
+    // consumer is reading it, and copies it to a snapshot slot if it is still
+    // waiting in the queue.
+    void reclaim(const Data& source)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_changed.wait(lock, [&] { return m_active != &source; });
+            auto queued = std::find_if(
+                m_queue.begin(), m_queue.end(), [&](const entry& e) {
+                    return e.source == &source;
+                });
+            if (queued == m_queue.end()) {
+                return;
+            }
+            const i64 index = _free_slot();
+            if (index < 0) {
+                m_changed.wait(lock);
+                continue;
+            }
+            Data& snapshot = m_slots[index].data;
+            _copy_snapshot(snapshot, source);
+            m_slots[index].busy = true;
+            queued->source = &snapshot;
+            queued->slot = index;
+            ++m_copies;
+        }
+    }
+
+    // Waits until the consumer has processed everything published so far.
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(
+            lock, [&] { return m_queue.empty() && m_active == nullptr; });
+    }
+
+    // Number of levels that had to be copied so far.
+    u64 copies()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_copies;
+    }
+};
+
+template<u32 dim, typename T>
+using snapshot_pipeline = basic_snapshot_pipeline<grid<dim, T>>;
+
+// Publishes the fields of a grid_set together, as one level.
+template<u32 dim, typename... T>
+using snapshot_set_pipeline = basic_snapshot_pipeline<grid_set<dim, T...>>;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <util.hpp>
+
+namespace stencil {
+
+// 16 bit floating point number with the exponent range of a float and 8 bits
+// of mantissa. Conversion from float rounds to nearest, ties to even.
+struct bfloat16
+{
+    u16 bits;
+
+    bfloat16() = default;
+
+    bfloat16(float value)
+    {
+        u32 x;
+        std::memcpy(&x, &value, sizeof(x));
+        if (std::isnan(value)) {
+            bits = static_cast<u16>((x >> 16) | 0x40);
+        } else {
+            bits = static_cast<u16>((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+        }
+    }
+
+    operator float() const
+    {
+        const u32 x = static_cast<u32>(bits) << 16;
+        float value;
+        std::memcpy(&value, &x, sizeof(value));
+        return value;
+    }
+};
+
+// Field type tag: cells are stored as Storage, but accessors convert them to
+// and from Compute on every read and write. E.g. mixed<float, double> halves
+// the memory traffic of a double precision kernel.
+template<typename Storage, typename Compute>
+struct mixed
+{};
+
+template<typename S, typename C>
+class converting_reference
+{
+    S* m_ptr;
+
+public:
+    explicit converting_reference(S* ptr)
+        : m_ptr(ptr)
+    {}
+
+    operator C() const { return static_cast<C>(*m_ptr); }
+
+    converting_reference& operator=(const C& value)
+    {
+        *m_ptr = static_cast<S>(value);
+        return *this;
+    }
+
+    converting_reference& operator=(const converting_reference& other)
+    {
+        return *this = static_cast<C>(other);
+    }
+
+    converting_reference& operator+=(const C& value)
+    {
+        return *this = static_cast<C>(*this) + value;
+    }
+
+    converting_reference& operator-=(const C& value)
+    {
+        return *this = static_cast<C>(*this) - value;
+    }
+
+    converting_reference& operator*=(const C& value)
+    {
+        return *this = static_cast<C>(*this) * value;
+    }
+
+    converting_reference& operator/=(const C& value)
+    {
+        return *this = static_cast<C>(*this) / value;
+    }
+};
+
+template<typename T>
+struct field_traits
+{
+    using storage_type = T;
+    using value_type = T;
+    using reference = T&;
+    using const_reference = const T&;
+
+    static inline reference ref(T* ptr) { return *ptr; }
+    static inline const_reference ref(const T* ptr) { return *ptr; }
+};
+
+template<typename S, typename C>
+struct field_traits<mixed<S, C>>
+{
+    using storage_type = S;
+    using value_type = C;
+    using reference = converting_reference<S, C>;
+    using const_reference = C;
+
+    static inline reference ref(S* ptr) { return reference(ptr); }
+    static inline const_reference ref(const S* ptr)
+    {
+        return static_cast<C>(*ptr);
+    }
+};
+
+template<typename T>
+using storage_t = typename field_traits<T>::storage_type;
+}
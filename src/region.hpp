@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <loop.hpp>
+#include <util.hpp>
+#include <vector>
+
+namespace stencil {
+
+// Box [from, to) visiting every step-th cell along each dimension.
+template<u32 dim>
+struct region
+{
+    std::array<u64, dim> from, to, step;
+
+    region(const std::array<u64, dim>& from, const std::array<u64, dim>& to)
+        : from(from)
+        , to(to)
+        , step(repeat<u64, dim>(1))
+    {}
+
+    region(const std::array<u64, dim>& from,
+           const std::array<u64, dim>& to,
+           const std::array<u64, dim>& step)
+        : from(from)
+        , to(to)
+        , step(step)
+    {}
+
+    std::array<u64, dim> count() const
+    {
+        std::array<u64, dim> result;
+        for (u32 i = 0; i < dim; ++i) {
+            result[i] = to[i] > from[i] ? (to[i] - from[i] + step[i] - 1) / step[i]
+                                        : 0;
+        }
+        return result;
+    }
+
+    // Whether every cell of the region is inside a grid of the given size.
+    bool fits(const std::array<u64, dim>& size) const
+    {
+        for (u32 i = 0; i < dim; ++i) {
+            if (step[i] == 0) {
+                return false;
+            }
+        }
+        const std::array<u64, dim> cells = count();
+        // an empty region visits nothing, wherever it is
+        for (u32 i = 0; i < dim; ++i) {
+            if (cells[i] == 0) {
+                return true;
+            }
+        }
+        for (u32 i = 0; i < dim; ++i) {
+            if (from[i] + (cells[i] - 1) * step[i] >= size[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool unit_step() const
+    {
+        for (u32 i = 0; i < dim; ++i) {
+            if (step[i] != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// The active cells of a grid, stored as runs of consecutive cells along the
+// first dimension.
+template<u32 dim>
+class run_index
+{
+public:
+    struct run
+    {
+        std::array<u64, dim> start;
+        u64 length;
+    };
+
+private:
+    std::vector<run> m_runs;
+    u64 m_cell_count;
+
+public:
+    run_index()
+        : m_cell_count(0)
+    {}
+
+    // Builds the index from a predicate called with the coordinates of each
+    // cell in [0, size).
+    template<typename Pred>
+    static run_index from_predicate(const std::array<u64, dim>& size,
+                                    const Pred& active)
+    {
+        run_index result;
+        std::array<u64, dim> rows = size;
+        rows[0] = 1;
+        loop<dim>(repeat<u64, dim>(0), rows, [&](const std::array<u64, dim>& it) {
+            std::array<u64, dim> cell = it;
+            u64 start = 0;
+            bool open = false;
+            for (cell[0] = 0; cell[0] < size[0]; ++cell[0]) {
+                const bool on = active(cell);
+                if (on && !open) {
+                    start = cell[0];
+                    open = true;
+                } else if (!on && open) {
+                    std::array<u64, dim> first = cell;
+                    first[0] = start;
+                    result.add_run(first, cell[0] - start);
+                    open = false;
+                }
+            }
+            if (open) {
+                std::array<u64, dim> first = cell;
+                first[0] = start;
+                result.add_run(first, size[0] - start);
+            }
+        });
+        return result;
+    }
+
+    // mask[x0 + size[0] * (x1 + size[1] * ...)] tells whether a cell is active.
+    static run_index from_bitmask(const std::array<u64, dim>& size,
+                                  const std::vector<bool>& mask)
+    {
+        return from_predicate(size, [&](const std::array<u64, dim>& it) {
+            u64 index = 0;
+            for (u32 i = dim; i > 0; --i) {
+                index = index * size[i - 1] + it[i - 1];
+            }
+            return mask[index];
+        });
+    }
+
+    void add_run(const std::array<u64, dim>& start, u64 length)
+    {
+        if (length == 0) {
+            return;
+        }
+        m_runs.push_back({ start, length });
+        m_cell_count += length;
+    }
+
+    // Whether every run is inside a grid of the given size.
+    bool fits(const std::array<u64, dim>& size) const
+    {
+        for (const run& r : m_runs) {
+            for (u32 i = 1; i < dim; ++i) {
+                if (r.start[i] >= size[i]) {
+                    return false;
+                }
+            }
+            if (r.start[0] + r.length > size[0]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const std::vector<run>& runs() const { return m_runs; }
+    u64 cell_count() const { return m_cell_count; }
+};
+}
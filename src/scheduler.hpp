@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <decomposition.hpp>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace stencil {
+
+// A fixed set of worker threads, each with its own task queue. Tasks submitted
+// from a worker go to the back of that worker's queue and are picked up from
+// there (most recent first); idle workers steal from the front of the others.
+class thread_pool : not_copyable
+{
+    struct task_queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<task_queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::atomic<u64> m_queued;
+    std::atomic<u64> m_submitted;
+    std::atomic<u64> m_next_queue;
+    bool m_stop;
+
+    struct worker_id
+    {
+        const thread_pool* pool;
+        u64 index;
+    };
+
+    static worker_id& _current_worker()
+    {
+        static thread_local worker_id id = { nullptr, 0 };
+        return id;
+    }
+
+    bool _pop(u64 index, std::function<void()>& task)
+    {
+        task_queue& queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        --m_queued;
+        return true;
+    }
+
+    bool _steal(u64 index, std::function<void()>& task)
+    {
+        for (u64 i = 1; i < m_queues.size(); ++i) {
+            task_queue& queue = *m_queues[(index + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                --m_queued;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void _work(u64 index)
+    {
+        _current_worker() = { this, index };
+        std::function<void()> task;
+        while (true) {
+            // Tasks submitted after this can't have been missed below, so
+            // sleep until there are any instead of scanning again.
+            const u64 submitted = m_submitted;
+            if (_pop(index, task) || _steal(index, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock,
+                        [&] { return m_stop || m_submitted != submitted; });
+            if (m_stop && m_queued == 0) {
+                return;
+            }
+        }
+    }
+
+public:
+    thread_pool(u64 threads = std::thread::hardware_concurrency())
+        : m_queued(0)
+        , m_submitted(0)
+        , m_next_queue(0)
+        , m_stop(false)
+    {
+        threads = std::max<u64>(threads, 1);
+        for (u64 i = 0; i < threads; ++i) {
+            m_queues.emplace_back(new task_queue());
+        }
+        for (u64 i = 0; i < threads; ++i) {
+            m_threads.emplace_back([this, i] { _work(i); });
+        }
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    u64 size() const { return m_threads.size(); }
+
+    void submit(std::function<void()> task)
+    {
+        const worker_id& current = _current_worker();
+        const u64 index = current.pool == this
+                              ? current.index
+                              : m_next_queue++ % m_queues.size();
+        {
+            std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+            m_queues[index]->tasks.push_back(std::move(task));
+        }
+        ++m_queued;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_submitted;
+        }
+        m_wake.notify_one();
+    }
+};
+
+// A set of tasks with dependencies between them. The graph is built once and
+// can be run any number of times; each run executes every task exactly once,
+// starting each one as soon as all of its dependencies have finished.
+class task_graph : not_copyable
+{
+    struct node
+    {
+        std::function<void()> work;
+        std::vector<u64> successors;
+        u64 dependencies;
+    };
+
+    std::vector<node> m_nodes;
+    std::unique_ptr<std::atomic<u64>[]> m_remaining;
+    u64 m_remaining_size;
+    std::atomic<u64> m_unfinished;
+    bool m_finished;
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+
+    void _execute(thread_pool& pool, u64 index)
+    {
+        m_nodes[index].work();
+        for (u64 successor : m_nodes[index].successors) {
+            if (--m_remaining[successor] == 0) {
+                pool.submit([this, &pool, successor] {
+                    _execute(pool, successor);
+                });
+            }
+        }
+        // run() only returns once m_finished is set, and it can't see it
+        // before the mutex is released, so this is the last access to the
+        // graph (which may be destroyed as soon as run() returns).
+        if (--m_unfinished == 0) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finished = true;
+            m_done.notify_all();
+        }
+    }
+
+public:
+    task_graph()
+        : m_remaining_size(0)
+        , m_unfinished(0)
+        , m_finished(false)
+    {}
+
+    u64 size() const { return m_nodes.size(); }
+
+    // Adds a task and returns its id. Dependencies have to be ids of tasks
+    // added earlier, so the graph can't contain cycles.
+    u64 add(std::function<void()> work, std::vector<u64> dependencies = {})
+    {
+        const u64 index = m_nodes.size();
+        std::sort(dependencies.begin(), dependencies.end());
+        dependencies.erase(std::unique(dependencies.begin(), dependencies.end()),
+                           dependencies.end());
+        for (u64 dependency : dependencies) {
+            assert(dependency < index);
+            m_nodes[dependency].successors.push_back(index);
+        }
+        m_nodes.push_back({ std::move(work), {}, dependencies.size() });
+        return index;
+    }
+
+    void run(thread_pool& pool)
+    {
+        if (m_nodes.empty()) {
+            return;
+        }
+        if (m_remaining_size != m_nodes.size()) {
+            m_remaining.reset(new std::atomic<u64>[m_nodes.size()]);
+            m_remaining_size = m_nodes.size();
+        }
+        for (u64 i = 0; i < m_nodes.size(); ++i) {
+            m_remaining[i] = m_nodes[i].dependencies;
+        }
+        m_unfinished = m_nodes.size();
+        m_finished = false;
+        for (u64 i = 0; i < m_nodes.size(); ++i) {
+            if (m_nodes[i].dependencies == 0) {
+                pool.submit([this, &pool, i] { _execute(pool, i); });
+            }
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&] { return m_finished; });
+    }
+};
+
+// Builds a task_graph of time steps over a decomposed_grid. Every step
+// consists of a halo exchange and a stencil sweep per subdomain; a subdomain's
+// sweep only waits for its own exchange, and an exchange only for the sweeps
+// of the neighbours it reads from (and for whoever still reads the data it is
+// about to overwrite). Steps added one after the other may overlap.
+template<u32 dim, typename... T>
+class step_graph : not_copyable
+{
+    struct field_state
+    {
+        std::vector<u64> interior_readers, halo_readers;
+        std::vector<u64> interior_writer, halo_writer;
+    };
+
+    decomposed_grid<dim, T...>& m_grids;
+    task_graph m_graph;
+    std::vector<std::array<field_state, sizeof...(T)>> m_state;
+
+    static void _append(std::vector<u64>& to, const std::vector<u64>& from)
+    {
+        to.insert(to.end(), from.begin(), from.end());
+    }
+
+    static void _write(std::vector<u64>& writer,
+                       std::vector<u64>& readers,
+                       u64 task)
+    {
+        writer.assign(1, task);
+        readers.clear();
+    }
+
+public:
+    step_graph(decomposed_grid<dim, T...>& grids)
+        : m_grids(grids)
+        , m_state(grids.subdomain_count())
+    {}
+
+    // Adds a step that exchanges the halo of field src and then calls
+    // func(global_coords, accessor) with an accessor over fields src and dst.
+    template<u32 rad, u32 src, u32 dst, typename Func>
+    void add_step(const Func& func)
+    {
+        static_assert(src != dst, "a step can't update a field in place");
+        const u64 count = m_grids.subdomain_count();
+        std::vector<u64> exchanges(count);
+        for (u64 s = 0; s < count; ++s) {
+            field_state& own = m_state[s][src];
+            std::vector<u64> deps = own.halo_writer;
+            _append(deps, own.halo_readers);
+            for (const auto& n : m_grids.neighbors(s)) {
+                _append(deps, m_state[n.index][src].interior_writer);
+            }
+            exchanges[s] = m_graph.add(
+                [this, s] { m_grids.template exchange_halo<src>(s); }, deps);
+        }
+        for (u64 s = 0; s < count; ++s) {
+            _write(m_state[s][src].halo_writer,
+                   m_state[s][src].halo_readers,
+                   exchanges[s]);
+            for (const auto& n : m_grids.neighbors(s)) {
+                m_state[n.index][src].interior_readers.push_back(exchanges[s]);
+            }
+        }
+        for (u64 s = 0; s < count; ++s) {
+            field_state& in = m_state[s][src];
+            field_state& out = m_state[s][dst];
+            std::vector<u64> deps = in.halo_writer;
+            _append(deps, in.interior_writer);
+            _append(deps, out.interior_writer);
+            _append(deps, out.interior_readers);
+            const u64 task = m_graph.add(
+                [this, s, func] {
+                    m_grids.template iterate_subdomain<rad, src, dst>(s, func);
+                },
+                deps);
+            in.halo_readers.push_back(task);
+            in.interior_readers.push_back(task);
+            _write(out.interior_writer, out.interior_readers, task);
+        }
+    }
+
+    u64 size() const { return m_graph.size(); }
+
+    void run(thread_pool& pool) { m_graph.run(pool); }
+};
+}
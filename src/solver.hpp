@@ -0,0 +1,388 @@
+#pragma once
+
+#include <algebra.hpp>
+#include <buffer.hpp>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+namespace stencil {
+
+// A linear operator y = A x given by a fixed stencil. The coefficients are
+// either the same for every cell, or stored per cell in iteration order, so
+// applying the operator reads them as one contiguous stream. The offsets are
+// only known at runtime, so each cell loops over them; for stencils that are
+// fixed at compile time, the expressions of expression.hpp are faster.
+template<u32 dim, u32 rad, typename T>
+class stencil_operator
+{
+    std::vector<std::array<i64, dim>> m_offsets;
+    std::array<u64, dim> m_size;
+    std::vector<T> m_coefficients;
+    bool m_constant;
+
+    static void _check_offsets(const std::vector<std::array<i64, dim>>& offsets)
+    {
+        for (const auto& offset : offsets) {
+            for (u32 i = 0; i < dim; ++i) {
+                assert(offset[i] >= -static_cast<i64>(rad) &&
+                       offset[i] <= static_cast<i64>(rad));
+                (void)offset;
+            }
+        }
+    }
+
+public:
+    // Variable coefficients, all zero initially.
+    stencil_operator(const std::array<u64, dim>& size,
+                     const std::vector<std::array<i64, dim>>& offsets)
+        : m_offsets(offsets)
+        , m_size(size)
+        , m_constant(false)
+    {
+        _check_offsets(offsets);
+        u64 cells = 1;
+        for (u32 i = 0; i < dim; ++i) {
+            cells *= size[i];
+        }
+        m_coefficients.assign(cells * offsets.size(), T(0));
+    }
+
+    // Constant coefficients, one per offset.
+    stencil_operator(const std::vector<std::array<i64, dim>>& offsets,
+                     const std::vector<T>& coefficients)
+        : m_offsets(offsets)
+        , m_size(repeat<u64, dim>(0))
+        , m_coefficients(coefficients)
+        , m_constant(true)
+    {
+        _check_offsets(offsets);
+        assert(offsets.size() == coefficients.size());
+    }
+
+    const std::vector<std::array<i64, dim>>& offsets() const
+    {
+        return m_offsets;
+    }
+
+    bool constant() const { return m_constant; }
+
+    // The coefficient of the k-th offset at the given cell.
+    T& coefficient(const std::array<u64, dim>& coords, u64 k)
+    {
+        if (m_constant) {
+            return m_coefficients[k];
+        }
+        u64 index = 0;
+        for (u32 i = dim; i > 0; --i) {
+            index = index * m_size[i - 1] + coords[i - 1];
+        }
+        return m_coefficients[index * m_offsets.size() + k];
+    }
+
+    // Computes y = A x on the interior of y and calls epilogue(x, y) with the
+    // values of each cell, which lets callers fuse reductions into the sweep.
+    template<typename Func>
+    void apply(grid<dim, T>& x, grid<dim, T>& y, const Func& epilogue) const
+    {
+        assert(x.halo_size() >= rad);
+        assert(x.stride() == y.stride());
+        assert(m_constant || x.size() == m_size);
+        const u64 count = m_offsets.size();
+        std::vector<i64> linear(count, 0);
+        for (u64 k = 0; k < count; ++k) {
+            for (u32 i = 0; i < dim; ++i) {
+                linear[k] += m_offsets[k][i] * static_cast<i64>(x.stride()[i]);
+            }
+        }
+        const std::array<i64, dim> zero = repeat<i64, dim>(0);
+        const T* coefficients = m_coefficients.data();
+        const u64 step = m_constant ? 0 : count;
+        iterate<0>(
+            [&](const std::array<u64, dim>&, accessor<0, dim, T, T>& acc) {
+                const T* center = &acc.template get<0>(zero);
+                T sum = 0;
+                for (u64 k = 0; k < count; ++k) {
+                    sum += coefficients[k] * center[linear[k]];
+                }
+                acc.template get<1>(zero) = sum;
+                epilogue(*center, sum);
+                coefficients += step;
+            },
+            x,
+            y);
+    }
+
+    void apply(grid<dim, T>& x, grid<dim, T>& y) const
+    {
+        apply(x, y, [](const T&, const T&) {});
+    }
+};
+
+struct solver_result
+{
+    u64 iterations;
+    double residual;
+    bool converged;
+};
+
+// Work vectors of the solvers, laid out like the grid they are created for.
+template<u32 dim, typename T, u32 count>
+class _solver_workspace : not_copyable
+{
+protected:
+    std::vector<grid<dim, T>> m_grids;
+
+    _solver_workspace(const grid<dim, T>& like)
+    {
+        for (u32 i = 0; i < count; ++i) {
+            m_grids.emplace_back(like.size(), like.halo_size());
+            m_grids.back().fill(T(0));
+        }
+    }
+
+    grid<dim, T>& _vector(u32 i) { return m_grids[i]; }
+
+    // r = b - A x, returns r.r
+    template<u32 rad>
+    static T _residual(const stencil_operator<dim, rad, T>& op,
+                       grid<dim, T>& x,
+                       grid<dim, T>& b,
+                       grid<dim, T>& r)
+    {
+        const std::array<i64, dim> zero = repeat<i64, dim>(0);
+        op.apply(x, r);
+        T rr = 0;
+        iterate<0>(
+            [&](const std::array<u64, dim>&, accessor<0, dim, T, T>& acc) {
+                const T value =
+                    acc.template get<1>(zero) - acc.template get<0>(zero);
+                acc.template get<0>(zero) = value;
+                rr += value * value;
+            },
+            r,
+            b);
+        return rr;
+    }
+};
+
+// Conjugate Gradient for symmetric positive definite operators. The halo of
+// x holds the (Dirichlet) boundary values and is left untouched. If p.A p
+// vanishes (e.g. for a singular operator), it stops early and reports no
+// convergence.
+template<u32 dim, typename T>
+class conjugate_gradient : _solver_workspace<dim, T, 3>
+{
+    using base = _solver_workspace<dim, T, 3>;
+
+public:
+    conjugate_gradient(const grid<dim, T>& like)
+        : base(like)
+    {}
+
+    template<u32 rad>
+    solver_result solve(const stencil_operator<dim, rad, T>& op,
+                        grid<dim, T>& x,
+                        grid<dim, T>& b,
+                        T tolerance,
+                        u64 max_iterations)
+    {
+        const std::array<i64, dim> zero = repeat<i64, dim>(0);
+        grid<dim, T>& r = this->_vector(0);
+        grid<dim, T>& p = this->_vector(1);
+        grid<dim, T>& q = this->_vector(2);
+        assert(x.stride() == r.stride());
+
+        const T limit = tolerance * tolerance * dot(b, b);
+        T rr = base::_residual(op, x, b, r);
+        copy(p, r);
+
+        u64 iteration = 0;
+        while (rr > limit && iteration < max_iterations) {
+            T pq = 0;
+            op.apply(p, q, [&](const T& pi, const T& qi) { pq += pi * qi; });
+            if (pq == 0) {
+                break;
+            }
+            const T alpha = rr / pq;
+
+            T rr_new = 0;
+            iterate<0>(
+                [&](const std::array<u64, dim>&,
+                    accessor<0, dim, T, T, T, T>& acc) {
+                    acc.template get<0>(zero) +=
+                        alpha * acc.template get<1>(zero);
+                    const T value = acc.template get<2>(zero) -
+                                    alpha * acc.template get<3>(zero);
+                    acc.template get<2>(zero) = value;
+                    rr_new += value * value;
+                },
+                x,
+                p,
+                r,
+                q);
+
+            const T beta = rr_new / rr;
+            rr = rr_new;
+            lincomb(p, T(1), r, beta, p);
+            ++iteration;
+        }
+        return { iteration, std::sqrt(static_cast<double>(rr)), rr <= limit };
+    }
+};
+
+// BiCGSTAB for general (non-symmetric) operators. The halo of x holds the
+// (Dirichlet) boundary values and is left untouched. If the method breaks
+// down (a division by zero), it stops early and reports no convergence.
+template<u32 dim, typename T>
+class bicgstab : _solver_workspace<dim, T, 6>
+{
+    using base = _solver_workspace<dim, T, 6>;
+
+public:
+    bicgstab(const grid<dim, T>& like)
+        : base(like)
+    {}
+
+    template<u32 rad>
+    solver_result solve(const stencil_operator<dim, rad, T>& op,
+                        grid<dim, T>& x,
+                        grid<dim, T>& b,
+                        T tolerance,
+                        u64 max_iterations)
+    {
+        const std::array<i64, dim> zero = repeat<i64, dim>(0);
+        grid<dim, T>& r = this->_vector(0);
+        grid<dim, T>& r0 = this->_vector(1);
+        grid<dim, T>& p = this->_vector(2);
+        grid<dim, T>& v = this->_vector(3);
+        grid<dim, T>& s = this->_vector(4);
+        grid<dim, T>& t = this->_vector(5);
+        assert(x.stride() == r.stride());
+
+        const T limit = tolerance * tolerance * dot(b, b);
+        T rr = base::_residual(op, x, b, r);
+        iterate<0>(
+            [&](const std::array<u64, dim>&,
+                accessor<0, dim, T, T, T, T>& acc) {
+                acc.template get<1>(zero) = acc.template get<0>(zero);
+                acc.template get<2>(zero) = 0;
+                acc.template get<3>(zero) = 0;
+            },
+            r,
+            r0,
+            p,
+            v);
+
+        T rho = 1, alpha = 1, omega = 1;
+        T rho_new = rr;
+        u64 iteration = 0;
+        while (rr > limit && iteration < max_iterations) {
+            const T beta = (rho_new / rho) * (alpha / omega);
+            rho = rho_new;
+            iterate<0>(
+                [&](const std::array<u64, dim>&,
+                    accessor<0, dim, T, T, T>& acc) {
+                    acc.template get<1>(zero) =
+                        acc.template get<0>(zero) +
+                        beta * (acc.template get<1>(zero) -
+                                omega * acc.template get<2>(zero));
+                },
+                r,
+                p,
+                v);
+
+            op.apply(p, v);
+            const T r0v = dot(r0, v);
+            if (r0v == 0) {
+                break;
+            }
+            alpha = rho / r0v;
+
+            T ss = 0;
+            iterate<0>(
+                [&](const std::array<u64, dim>&,
+                    accessor<0, dim, T, T, T>& acc) {
+                    const T value = acc.template get<0>(zero) -
+                                    alpha * acc.template get<1>(zero);
+                    acc.template get<2>(zero) = value;
+                    ss += value * value;
+                },
+                r,
+                v,
+                s);
+            if (ss <= limit) {
+                axpy(alpha, p, x);
+                rr = ss;
+                ++iteration;
+                break;
+            }
+
+            T ts = 0, tt = 0;
+            op.apply(s, t, [&](const T& si, const T& ti) {
+                ts += si * ti;
+                tt += ti * ti;
+            });
+            if (tt == 0) {
+                // A s = 0, so s can't be reduced any further
+                axpy(alpha, p, x);
+                rr = ss;
+                ++iteration;
+                break;
+            }
+            omega = ts / tt;
+
+            rr = 0;
+            rho_new = 0;
+            iterate<0>(
+                [&](const std::array<u64, dim>&,
+                    accessor<0, dim, T, T, T, T, T, T>& acc) {
+                    acc.template get<0>(zero) +=
+                        alpha * acc.template get<1>(zero) +
+                        omega * acc.template get<2>(zero);
+                    const T value = acc.template get<2>(zero) -
+                                    omega * acc.template get<3>(zero);
+                    acc.template get<4>(zero) = value;
+                    rr += value * value;
+                    rho_new += acc.template get<5>(zero) * value;
+                },
+                x,
+                p,
+                s,
+                t,
+                r,
+                r0);
+            ++iteration;
+            if (omega == 0 || rho_new == 0) {
+                break;
+            }
+        }
+        return { iteration, std::sqrt(static_cast<double>(rr)), rr <= limit };
+    }
+};
+}
+
+#ifdef STENCIL_EXTERN_TEMPLATES
+namespace stencil {
+#define STENCIL_EXTERN_SOLVER(dim, T)                                          \
+    extern template class stencil_operator<dim, 1, T>;                         \
+    extern template class conjugate_gradient<dim, T>;                          \
+    extern template class bicgstab<dim, T>;                                    \
+    extern template solver_result conjugate_gradient<dim, T>::solve<1>(        \
+        const stencil_operator<dim, 1, T>&,                                    \
+        grid<dim, T>&,                                                         \
+        grid<dim, T>&,                                                         \
+        T,                                                                     \
+        u64);                                                                  \
+    extern template solver_result bicgstab<dim, T>::solve<1>(                  \
+        const stencil_operator<dim, 1, T>&,                                    \
+        grid<dim, T>&,                                                         \
+        grid<dim, T>&,                                                         \
+        T,                                                                     \
+        u64);
+
+STENCIL_INSTANCES(STENCIL_EXTERN_SOLVER)
+
+#undef STENCIL_EXTERN_SOLVER
+}
+#endif
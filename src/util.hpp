@@ -4,6 +4,16 @@
 #include <cstdint>
 #include <tuple>
 
+#define STENCIL_STRINGIFY(...) #__VA_ARGS__
+
+// An OpenMP pragma, which disappears when compiling without OpenMP instead of
+// triggering -Wunknown-pragmas.
+#ifdef _OPENMP
+#define STENCIL_OMP(...) _Pragma(STENCIL_STRINGIFY(omp __VA_ARGS__))
+#else
+#define STENCIL_OMP(...)
+#endif
+
 namespace stencil {
 using u8 = uint8_t;
 using u16 = uint16_t;
@@ -19,6 +29,8 @@ struct not_copyable
     not_copyable() {}
     not_copyable(const not_copyable&) = delete;
     not_copyable& operator=(const not_copyable&) = delete;
+    not_copyable(not_copyable&&) = default;
+    not_copyable& operator=(not_copyable&&) = default;
 };
 
 struct not_movable
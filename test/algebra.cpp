@@ -0,0 +1,138 @@
+#include <algebra.hpp>
+#include <catch2/catch.hpp>
+
+namespace stencil {
+namespace {
+template<typename T>
+void set_cells(grid<2, T>& g, double offset)
+{
+    for (u64 x = 0; x < g.size()[0]; ++x) {
+        for (u64 y = 0; y < g.size()[1]; ++y) {
+            g.get({ x, y }) = static_cast<double>(x + 10 * y) + offset;
+        }
+    }
+}
+}
+
+TEST_CASE("copy and swap_contents", "[algebra]")
+{
+    buffer<2, double> buf({ 7, 6 });
+    grid<2, double> whole({ 7, 6 }, 0, { 0, 0 }, &buf);
+    whole.fill(-1.0);
+    grid<2, double> a({ 4, 3 }, 1, { 2, 2 }, &buf);
+    grid<2, double> b({ 4, 3 }, 2);
+    b.fill(-2.0);
+    set_cells(a, 0.5);
+
+    copy(b, a);
+    for (u64 x = 0; x < 4; ++x) {
+        for (u64 y = 0; y < 3; ++y) {
+            CHECK(b.get({ x, y }) == x + 10 * y + 0.5);
+        }
+    }
+    CHECK(b.get_raw({ 0, 0 }) == -2.0);
+    CHECK(b.get_raw({ 1, 2 }) == -2.0);
+    CHECK(whole.get({ 1, 1 }) == -1.0);
+
+    set_cells(b, 100.0);
+    swap_contents(a, b);
+    CHECK(a.get({ 3, 2 }) == 123.0);
+    CHECK(b.get({ 3, 2 }) == 23.5);
+    CHECK(whole.get({ 6, 5 }) == -1.0);
+
+    grid<2, double> c({ 4, 3 }, 1);
+    c.fill(0.0);
+    copy_raw(c, a);
+    CHECK(c.get_raw({ 0, 0 }) == -1.0);
+    CHECK(c.get({ 1, 1 }) == 111.0);
+}
+
+TEST_CASE("scale, axpy and lincomb", "[algebra]")
+{
+    grid<2, double> x({ 5, 4 }, 1);
+    grid<2, double> y({ 5, 4 }, 1);
+    grid<2, double> z({ 5, 4 }, 1);
+    x.fill(9.0);
+    y.fill(9.0);
+    z.fill(9.0);
+    set_cells(x, 1.0);
+    set_cells(y, 2.0);
+
+    scale(2.0, x);
+    CHECK(x.get({ 4, 3 }) == 70.0);
+    CHECK(x.get_raw({ 0, 0 }) == 9.0);
+
+    axpy(0.5, x, y);
+    CHECK(y.get({ 4, 3 }) == 71.0);
+    CHECK(y.get({ 0, 0 }) == 3.0);
+
+    lincomb(z, 1.0, x, -1.0, y);
+    CHECK(z.get({ 4, 3 }) == -1.0);
+    CHECK(z.get({ 2, 1 }) == -1.0);
+    CHECK(z.get_raw({ 6, 5 }) == 9.0);
+}
+
+TEST_CASE("dot", "[algebra]")
+{
+    grid<2, double> x({ 3, 2 }, 1);
+    grid<2, double> y({ 3, 2 }, 2);
+    x.fill(100.0);
+    y.fill(100.0);
+    set_cells(x, 0.0);
+    set_cells(y, 1.0);
+    // (0 1 2 10 11 12) . (1 2 3 11 12 13)
+    CHECK(dot(x, y) == 0 + 2 + 6 + 110 + 132 + 156);
+
+    // large enough to be split between threads
+    grid<3, double> a({ 40, 30, 50 }, 1);
+    grid<3, double> b({ 40, 30, 50 }, 0);
+    a.fill(2.0);
+    b.fill(0.25);
+    CHECK(dot(a, b) == Approx(0.5 * 40 * 30 * 50));
+}
+
+TEST_CASE("algebra with mixed fields", "[algebra]")
+{
+    grid<2, mixed<float, double>> x({ 4, 4 }, 1);
+    grid<2, double> y({ 4, 4 }, 1);
+    x.fill(0.5);
+    y.fill(1.0);
+    axpy(2.0, x, y);
+    CHECK(y.get({ 3, 3 }) == 2.0);
+    scale(4.0, x);
+    CHECK(x.get_raw({ 1, 1 }) == 2.0f);
+    CHECK(dot(x, y) == 16 * 4.0);
+    copy(x, y);
+    CHECK(x.get({ 0, 0 }) == 2.0f);
+}
+
+TEST_CASE("algebra on grid_sets", "[algebra]")
+{
+    grid_set<2, double, float> x({ 3, 3 }, 1);
+    grid_set<2, double, float> y({ 3, 3 }, 1);
+    x.get<0>().fill(1.0);
+    x.get<1>().fill(2.0f);
+    y.get<0>().fill(3.0);
+    y.get<1>().fill(4.0f);
+
+    axpy(2, x, y);
+    CHECK(y.get<0>().get({ 1, 1 }) == 5.0);
+    CHECK(y.get<1>().get({ 1, 1 }) == 8.0f);
+
+    scale(0.5, y);
+    CHECK(y.get<0>().get({ 2, 2 }) == 2.5);
+    CHECK(y.get<1>().get({ 2, 2 }) == 4.0f);
+
+    swap_contents(x, y);
+    CHECK(x.get<0>().get({ 0, 0 }) == 2.5);
+    CHECK(y.get<1>().get({ 0, 0 }) == 2.0f);
+
+    lincomb(y, 1.0, x, -1.0, y);
+    CHECK(y.get<0>().get({ 0, 2 }) == 1.5);
+    CHECK(y.get<1>().get({ 0, 2 }) == 2.0f);
+
+    copy(x, y);
+    CHECK(x.get<1>().get({ 1, 0 }) == 2.0f);
+    CHECK(x.get<0>().get_raw({ 0, 0 }) == 1.0);
+}
+}
@@ -179,6 +179,136 @@ TEST_CASE("copy_halo", "[grid]")
     }
 }
 
+TEST_CASE("iterate sub-grid", "[grid]")
+{
+    buffer<2, int> buf1({ 7, 5 });
+    grid<2, int> grid1({ 3, 2 }, 1, { 1, 1 }, &buf1);
+    iterate<0>(
+        [&](const std::array<u64, 2>& it, accessor<0, 2, int>& acc) {
+            acc.get({ 0, 0 }) = 10 * it[0] + it[1];
+        },
+        grid1);
+    for (u32 i = 0; i < 3; ++i) {
+        for (u32 j = 0; j < 2; ++j) {
+            INFO(i << " " << j);
+            CHECK(grid1.get({ i, j }) == static_cast<int>(10 * i + j));
+        }
+    }
+}
+
+TEST_CASE("copy_halo unaligned", "[grid]")
+{
+    // left: 3x4 cells at (0, 0), right: 2x2 cells at (3, 1)
+    buffer<2, int> buf1({ 5, 6 });
+    buffer<2, int> buf2({ 4, 4 });
+    grid<2, int> left({ 3, 4 }, 1, { 1, 1 }, &buf1);
+    grid<2, int> right({ 2, 2 }, 1, { 1, 1 }, &buf2);
+    iterate<0>(
+        [&](const std::array<u64, 2>& it, accessor<0, 2, int>& acc) {
+            acc.get({ 0, 0 }) = 10 * it[0] + it[1];
+        },
+        left);
+    right.fill(-1);
+    left.fill_halo(-1);
+
+    auto overlap = right.find_halo_overlap(left, { 3, 1 }, { 0, 0 });
+    CHECK_FALSE(overlap.empty());
+    CHECK(overlap.len == (std::array<u64, 2>{ { 1, 4 } }));
+    right.copy_halo_from(left, overlap);
+    for (u32 j = 0; j < 4; ++j) {
+        INFO(j);
+        CHECK(right.get_raw({ 0, j }) == static_cast<int>(20 + j));
+    }
+    CHECK(right.get_raw({ 1, 0 }) == -1);
+    CHECK(right.get_raw({ 3, 3 }) == -1);
+
+    iterate<0>(
+        [&](const std::array<u64, 2>& it, accessor<0, 2, int>& acc) {
+            acc.get({ 0, 0 }) = 100 + 10 * it[0] + it[1];
+        },
+        right);
+    left.copy_halo_from(right, { 0, 0 }, { 3, 1 });
+    CHECK(left.get_raw({ 4, 0 }) == -1);
+    CHECK(left.get_raw({ 4, 1 }) == -1);
+    CHECK(left.get_raw({ 4, 2 }) == 100);
+    CHECK(left.get_raw({ 4, 3 }) == 101);
+    CHECK(left.get_raw({ 4, 4 }) == -1);
+    CHECK(left.get_raw({ 4, 5 }) == -1);
+
+    CHECK(left.find_halo_overlap(right, { 0, 0 }, { 10, 1 }).empty());
+}
+
+TEST_CASE("owning grids", "[grid]")
+{
+    grid<2, int> g1({ 3, 2 }, 1);
+    CHECK(g1.size_with_halo() == (std::array<u64, 2>{ { 5, 4 } }));
+    g1.fill(1);
+    g1.get({ 2, 1 }) = 5;
+    const int* cell = &g1.get({ 2, 1 });
+
+    grid<2, int> g2(std::move(g1));
+    CHECK(&g2.get({ 2, 1 }) == cell);
+
+    grid<2, int> g3({ 1, 1 }, 0);
+    g3 = std::move(g2);
+    CHECK(&g3.get({ 2, 1 }) == cell);
+    CHECK(g3.size() == (std::array<u64, 2>{ { 3, 2 } }));
+    CHECK(g3.get_raw({ 0, 0 }) == 1);
+
+    std::vector<grid<2, int>> grids;
+    grids.push_back(std::move(g3));
+    grids.emplace_back(std::array<u64, 2>{ { 4, 4 } }, 2);
+    CHECK(&grids[0].get({ 2, 1 }) == cell);
+}
+
+TEST_CASE("grid views", "[grid]")
+{
+    grid<2, int> sub({ 1, 1 }, 0);
+    {
+        grid<2, int> g({ 4, 3 }, 1);
+        g.fill(0);
+        g.get({ 2, 1 }) = 7;
+
+        grid<2, int> same = g.view();
+        CHECK(&same.get({ 2, 1 }) == &g.get({ 2, 1 }));
+        CHECK(same.halo_size() == 1);
+
+        sub = g.view({ 1, 0 }, { 2, 2 }, 1);
+        CHECK(&sub.get({ 1, 1 }) == &g.get({ 2, 1 }));
+        CHECK(&sub.get_raw({ 0, 0 }) == &g.get_raw({ 1, 0 }));
+    }
+    // the view keeps the buffer alive
+    CHECK(sub.get({ 1, 1 }) == 7);
+    sub.get({ 1, 1 }) = 8;
+    CHECK(sub.get({ 1, 1 }) == 8);
+
+    buffer<2, int> buf({ 6, 6 });
+    grid<2, int> borrowed({ 2, 2 }, 2, { 2, 2 }, &buf);
+    grid<2, int> inner = borrowed.view({ 1, 1 }, { 1, 1 }, 1);
+    inner.get({ 0, 0 }) = 3;
+    CHECK(borrowed.get({ 1, 1 }) == 3);
+}
+
+TEST_CASE("move grid_set", "[grid_set]")
+{
+    std::vector<grid_set<2, int, double>> sets;
+    for (int i = 0; i < 4; ++i) {
+        sets.emplace_back(std::array<u64, 2>{ { 3, 3 } }, 1);
+        sets.back().get<0>().get({ 0, 0 }) = i;
+    }
+    const int* first = &sets[0].get<0>().get({ 0, 0 });
+    std::swap(sets[0], sets[3]);
+    CHECK(sets[0].get<0>().get({ 0, 0 }) == 3);
+    CHECK(&sets[3].get<0>().get({ 0, 0 }) == first);
+    CHECK(sets[3].get<0>().get({ 0, 0 }) == 0);
+
+    buffer_set<2, int, int> bufs({ 4, 4 });
+    buffer_set<2, int, int> moved(std::move(bufs));
+    grid_set<2, int, int> grids({ 2, 2 }, 1, { 1, 1 }, moved);
+    grids.get<1>().fill(2);
+    CHECK(moved.get<1>().get(0) == 2);
+}
+
 TEST_CASE("create grid_set", "[grid_set]")
 {
     buffer_set<2, int, int> bufs1({ 6, 6 });
@@ -0,0 +1,99 @@
+#include <catch2/catch.hpp>
+#include <decomposition.hpp>
+
+namespace stencil {
+TEST_CASE("choose_layout", "[decomposition]")
+{
+    CHECK(choose_layout<2>({ 100, 100 }, 4) ==
+          (std::array<u64, 2>{ { 2, 2 } }));
+    CHECK(choose_layout<2>({ 400, 100 }, 4) ==
+          (std::array<u64, 2>{ { 4, 1 } }));
+    CHECK(choose_layout<3>({ 10, 10, 10 }, 8) ==
+          (std::array<u64, 3>{ { 2, 2, 2 } }));
+    CHECK(choose_layout<2>({ 100, 100 }, 7) ==
+          (std::array<u64, 2>{ { 1, 7 } }));
+    CHECK(choose_layout<2>({ 3, 100 }, 6) ==
+          (std::array<u64, 2>{ { 1, 6 } }));
+    CHECK_THROWS_AS(choose_layout<2>({ 2, 2 }, 5), std::invalid_argument);
+}
+
+TEST_CASE("decomposed_grid exchange", "[decomposition]")
+{
+    decomposed_grid<2, int, int> grids({ 10, 7 }, 1, 4);
+    REQUIRE(grids.subdomain_count() == 4);
+    CHECK(grids.subdomain_size(0) == (std::array<u64, 2>{ { 5, 3 } }));
+    CHECK(grids.subdomain_size(3) == (std::array<u64, 2>{ { 5, 4 } }));
+    CHECK(grids.origin(3) == (std::array<u64, 2>{ { 5, 3 } }));
+    for (u64 s = 0; s < 4; ++s) {
+        CHECK(grids.neighbors(s).size() == 3);
+    }
+
+    grids.fill<0>(-1);
+    grids.iterate<0, 0>(
+        [](const std::array<u64, 2>& it, accessor<0, 2, int>& acc) {
+            acc.get({ 0, 0 }) = 100 * it[0] + it[1];
+        });
+    grids.exchange_halo<0>();
+    grids.iterate<1, 0, 1>(
+        [](const std::array<u64, 2>& it, accessor<1, 2, int, int>& acc) {
+            int errors = 0;
+            for (i64 x = -1; x <= 1; ++x) {
+                for (i64 y = -1; y <= 1; ++y) {
+                    const i64 gx = it[0] + x, gy = it[1] + y;
+                    const int expected =
+                        gx < 0 || gy < 0 || gx >= 10 || gy >= 7
+                            ? -1
+                            : 100 * gx + gy;
+                    errors += acc.get<0>({ x, y }) != expected;
+                }
+            }
+            acc.get<1>({ 0, 0 }) = errors;
+        });
+    for (u64 s = 0; s < 4; ++s) {
+        auto& g = grids.get(s).get<1>();
+        for (u64 x = 0; x < g.size()[0]; ++x) {
+            for (u64 y = 0; y < g.size()[1]; ++y) {
+                CHECK(g.get({ x, y }) == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("decomposed_grid rebalance", "[decomposition]")
+{
+    decomposed_grid<2, double> grids({ 64, 64 }, 1, 2);
+    REQUIRE(grids.layout() == (std::array<u64, 2>{ { 1, 2 } }));
+    grids.iterate<0, 0>(
+        [](const std::array<u64, 2>& it, accessor<0, 2, double>& acc) {
+            acc.get({ 0, 0 }) = it[0] + 1000 * it[1];
+        });
+    grids.reset_times();
+    grids.add_time(0, 3.0);
+    grids.add_time(1, 1.0);
+    grids.rebalance();
+
+    // half of the total time is reached at 2/3 of the first subdomain
+    CHECK(grids.subdomain_size(0)[1] == 21);
+    CHECK(grids.subdomain_size(0)[1] + grids.subdomain_size(1)[1] == 64);
+    CHECK(grids.origin(1)[1] == grids.subdomain_size(0)[1]);
+    for (double time : grids.times()) {
+        CHECK(time == 0);
+    }
+    u64 errors = 0;
+    grids.iterate<0, 0>(
+        [&](const std::array<u64, 2>& it, accessor<0, 2, double>& acc) {
+            errors += acc.get({ 0, 0 }) != it[0] + 1000 * it[1];
+        });
+    CHECK(errors == 0);
+}
+
+TEST_CASE("decomposed_grid rebalance narrow", "[decomposition]")
+{
+    // 4 subdomains of at least 2 cells don't fit into 6
+    decomposed_grid<1, double> grids({ 6 }, 2, 4);
+    grids.add_time(0, 10.0);
+    grids.rebalance();
+    CHECK(grids.subdomain_size(0)[0] == 1);
+    CHECK(grids.subdomain_size(3)[0] == 2);
+}
+}
@@ -0,0 +1,99 @@
+#include <algebra.hpp>
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <dispatch.hpp>
+
+namespace stencil {
+namespace {
+struct results
+{
+    std::vector<double> cells;
+    double norm;
+};
+
+std::array<std::atomic<u64>, 3> runs;
+
+void count_run(isa variant)
+{
+    ++runs[static_cast<u32>(variant)];
+}
+
+results run_kernels()
+{
+    grid<2, double> a({ 37, 29 }, 1);
+    grid<2, double> b({ 37, 29 }, 1);
+    a.fill(0.5);
+    b.fill(0.0);
+    iterate<0>(
+        [](const std::array<u64, 2>& it, accessor<0, 2, double>& acc) {
+            acc.get({ 0, 0 }) = 0.1 * it[0] - 0.05 * it[1] * it[1];
+        },
+        a);
+
+    dispatched([&] {
+        iterate<1>(
+            [](const std::array<u64, 2>&, accessor<1, 2, double, double>& acc) {
+                acc.get<1>({ 0, 0 }) =
+                    acc.get<0>({ 0, 0 }) +
+                    0.2 * (acc.get<0>({ -1, 0 }) + acc.get<0>({ 1, 0 }) +
+                           acc.get<0>({ 0, -1 }) + acc.get<0>({ 0, 1 }) -
+                           4 * acc.get<0>({ 0, 0 }));
+            },
+            a,
+            b);
+        axpy(0.3, b, a);
+        iterate_periodic<1>(
+            [](const std::array<u64, 2>&, accessor<1, 2, double, double>& acc) {
+                acc.get<1>({ 0, 0 }) =
+                    0.5 * (acc.get<0>({ -1, 1 }) + acc.get<0>({ 1, -1 }));
+            },
+            a,
+            b);
+    });
+    results result;
+    dispatched([&] { result.norm = dot(a, b); });
+    for (u64 x = 0; x < 37; ++x) {
+        for (u64 y = 0; y < 29; ++y) {
+            result.cells.push_back(a.get({ x, y }));
+        }
+    }
+    return result;
+}
+}
+
+TEST_CASE("select_isa", "[dispatch]")
+{
+    const isa supported = supported_isa();
+    select_isa(isa::baseline);
+    CHECK(selected_isa() == isa::baseline);
+    select_isa(isa::avx512);
+    CHECK(selected_isa() == supported);
+    CHECK(selected_isa() <= isa::avx512);
+}
+
+TEST_CASE("dispatched variants agree", "[dispatch]")
+{
+    set_dispatch_hook(count_run);
+    select_isa(isa::baseline);
+    const results expected = run_kernels();
+    for (isa target : { isa::avx2, isa::avx512 }) {
+        select_isa(target);
+        for (auto& count : runs) {
+            count = 0;
+        }
+        const results result = run_kernels();
+        // only the selected variant ran
+        for (u32 i = 0; i < 3; ++i) {
+            INFO("variant " << i);
+            CHECK((runs[i] > 0) == (i == static_cast<u32>(selected_isa())));
+        }
+        CHECK(result.norm == Approx(expected.norm));
+        REQUIRE(result.cells.size() == expected.cells.size());
+        for (u64 i = 0; i < result.cells.size(); ++i) {
+            CHECK(result.cells[i] == Approx(expected.cells[i]));
+        }
+    }
+    select_isa(supported_isa());
+    set_dispatch_hook(nullptr);
+}
+}
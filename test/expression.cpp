@@ -0,0 +1,213 @@
+#include <catch2/catch.hpp>
+#include <expression.hpp>
+
+namespace stencil {
+TEST_CASE("expression radius", "[expression]")
+{
+    auto u = field<0>();
+    static_assert(decltype(u)::radius == 0, "");
+    static_assert(decltype(laplace(u))::radius == 1, "");
+    static_assert(decltype(shift<2, -1>(u))::radius == 2, "");
+    static_assert(decltype(u + 0.5 * shift<0, -3>(u))::radius == 3, "");
+    static_assert(decltype(laplace(laplace(u)))::radius == 2, "");
+    auto first = assign<1>(laplace(u));
+    auto second = assign<2>(field<1>() + shift<1, 0>(field<1>()));
+    static_assert(decltype(fuse(first, second))::radius == 2, "");
+    static_assert(decltype(fuse(first, second))::output == 2, "");
+    static_assert(decltype(fuse(first, second, second))::radius == 3, "");
+    static_assert(!decltype(fuse(first, second))::clobbers<0>(), "");
+    auto back = assign<0>(laplace(field<1>()));
+    static_assert(decltype(fuse(first, back))::clobbers<0>(), "");
+    static_assert(decltype(fuse(first, second, back))::clobbers<0>(), "");
+}
+
+TEST_CASE("apply expression", "[expression]")
+{
+    buffer<2, double> buf1({ 8, 7 });
+    buffer<2, double> buf2({ 8, 7 });
+    buffer<2, double> buf3({ 8, 7 });
+    grid<2, double> grid1({ 6, 5 }, 1, { 1, 1 }, &buf1);
+    grid<2, double> grid2({ 6, 5 }, 1, { 1, 1 }, &buf2);
+    grid<2, double> grid3({ 6, 5 }, 1, { 1, 1 }, &buf3);
+    for (u64 x = 0; x < 8; ++x) {
+        for (u64 y = 0; y < 7; ++y) {
+            grid1.get_raw({ x, y }) = x * x + 10.0 * y + (x * y) % 3;
+        }
+    }
+
+    auto u = field<0>();
+    apply(assign<1>(u + 0.2 * laplace(u)), grid1, grid2);
+    iterate<1>(
+        [](const std::array<u64, 2>&, accessor<1, 2, double, double>& acc) {
+            acc.get<1>({ 0, 0 }) =
+                acc.get<0>({ 0, 0 }) +
+                0.2 * (acc.get<0>({ -1, 0 }) + acc.get<0>({ 1, 0 }) +
+                       acc.get<0>({ 0, -1 }) + acc.get<0>({ 0, 1 }) -
+                       4 * acc.get<0>({ 0, 0 }));
+        },
+        grid1,
+        grid3);
+    apply(assign<2>(shift<1, 0>(u) - shift<-1, 0>(u)), grid1, grid3, grid2);
+
+    for (u64 x = 0; x < 6; ++x) {
+        for (u64 y = 0; y < 5; ++y) {
+            INFO(x << " " << y);
+            CHECK(grid2.get({ x, y }) == grid1.get({ x + 1, y }) -
+                                             grid1.get_raw({ x, y + 1 }));
+        }
+    }
+    apply(assign<1>(u + 0.2 * laplace(u)), grid1, grid2);
+    for (u64 x = 0; x < 6; ++x) {
+        for (u64 y = 0; y < 5; ++y) {
+            INFO(x << " " << y);
+            CHECK(grid2.get({ x, y }) == grid3.get({ x, y }));
+        }
+    }
+}
+
+TEST_CASE("fused stages", "[expression]")
+{
+    buffer_set<2, double, mixed<float, double>, double> bufs({ 9, 8 });
+    grid_set<2, double, mixed<float, double>, double> grids(
+        { 5, 4 }, 2, { 2, 2 }, bufs);
+    auto& input = grids.get<0>();
+    for (u64 x = 0; x < 9; ++x) {
+        for (u64 y = 0; y < 8; ++y) {
+            input.get_raw({ x, y }) = x * x * x * x + y * y * y * y;
+        }
+    }
+    grids.get<1>().fill(-1.0);
+
+    // The discrete bilaplacian of x^4 + y^4 is 48 everywhere
+    auto u = field<0>();
+    auto stages =
+        fuse(assign<1>(laplace(u)), assign<2>(laplace(field<1>())));
+    grids.subset<0, 1, 2>().iterate<decltype(stages)::radius>(kernel(stages));
+    for (u64 x = 0; x < 5; ++x) {
+        for (u64 y = 0; y < 4; ++y) {
+            INFO(x << " " << y);
+            CHECK(grids.get<2>().get({ x, y }) == 48);
+            CHECK(grids.get<1>().get({ x, y }) == -1);
+        }
+    }
+}
+
+TEST_CASE("apply buffered fusion", "[expression]")
+{
+    // large enough to be split into several slabs
+    grid_set<3, double, double, double, double> grids({ 40, 40, 30 }, 3);
+    auto& g0 = grids.get<0>();
+    auto& g1 = grids.get<1>();
+    auto& g2 = grids.get<2>();
+    auto& g3 = grids.get<3>();
+    loop<3>({ 0, 0, 0 }, g0.size_with_halo(), [&](const auto& it) {
+        g0.get_raw(it) = std::sin(0.3 * it[0]) + 0.01 * it[1] * it[2];
+    });
+    auto u = field<0>();
+    auto first = assign<1>(u + 0.1 * laplace(u));
+    auto second = assign<2>(laplace(field<1>()) - shift<0, 0, 1>(u));
+
+    // the same two stages in two sweeps, the first one including the cells
+    // around the interior which the second one reads
+    const std::array<u64, 3> size = g0.size();
+    auto v0 = g0.view({ 0, 0, 0 }, size, 1).raw_view(1);
+    auto v1 = g1.view({ 0, 0, 0 }, size, 1).raw_view(1);
+    auto v2 = g2.view({ 0, 0, 0 }, size, 1).raw_view(1);
+    apply(first, v0, v1, v2);
+    apply(second, g0, g1, g3);
+
+    g1.fill(-1.0);
+    apply(fuse(first, second), g0, g1, g2);
+    u64 errors = 0;
+    for (u64 z = 0; z < 30; ++z) {
+        for (u64 y = 0; y < 40; ++y) {
+            for (u64 x = 0; x < 40; ++x) {
+                errors += g2.get({ x, y, z }) != g3.get({ x, y, z });
+                errors += g1.get({ x, y, z }) != -1.0;
+            }
+        }
+    }
+    CHECK(errors == 0);
+}
+
+TEST_CASE("nested fusion", "[expression]")
+{
+    grid_set<2, double, double, double, double> grids({ 9, 8 }, 3);
+    auto& g0 = grids.get<0>();
+    for (u64 x = 0; x < 15; ++x) {
+        for (u64 y = 0; y < 14; ++y) {
+            g0.get_raw({ x, y }) = x * x * x + 2.0 * y * y + x * y;
+        }
+    }
+    auto a = assign<1>(laplace(field<0>()));
+    auto b = assign<2>(shift<1, 0>(field<1>()));
+    // reads the output of a, which is not the output of fuse(a, b)
+    auto c = assign<3>(laplace(field<1>()) + field<1>() + field<2>());
+    grids.get<1>().fill(0.0);
+    grids.get<2>().fill(0.0);
+    apply(fuse(a, b, c), g0, grids.get<1>(), grids.get<2>(), grids.get<3>());
+    for (u64 x = 0; x < 9; ++x) {
+        for (u64 y = 0; y < 8; ++y) {
+            // field 1 is 6x + 4 in raw coordinates, its laplacian 0
+            INFO(x << " " << y);
+            CHECK(grids.get<3>().get({ x, y }) ==
+                  6.0 * (x + 3) + 4 + 6.0 * (x + 4) + 4);
+        }
+    }
+    CHECK(grids.get<1>().get({ 0, 0 }) == 0.0);
+}
+
+TEST_CASE("fusion overwriting its input", "[expression]")
+{
+    // the second stage writes field 0, which the first one reads, so fusing
+    // them must not change the result
+    grid_set<3, double, double> fused({ 40, 40, 30 }, 2);
+    grid_set<3, double, double> unfused({ 40, 40, 30 }, 2);
+    loop<3>({ 0, 0, 0 }, fused.get<0>().size_with_halo(), [&](const auto& it) {
+        const double value = std::sin(0.3 * it[0]) + 0.01 * it[1] * it[2];
+        fused.get<0>().get_raw(it) = value;
+        unfused.get<0>().get_raw(it) = value;
+    });
+    fused.get<1>().fill(0.0);
+    unfused.get<1>().fill(0.0);
+    auto first = assign<1>(laplace(field<0>()));
+    auto second = assign<0>(laplace(field<1>()));
+
+    apply(first, unfused.get<0>(), unfused.get<1>());
+    apply(second, unfused.get<0>(), unfused.get<1>());
+    apply(fuse(first, second), fused.get<0>(), fused.get<1>());
+    u64 errors = 0;
+    for (u64 z = 0; z < 30; ++z) {
+        for (u64 y = 0; y < 40; ++y) {
+            for (u64 x = 0; x < 40; ++x) {
+                errors += fused.get<0>().get({ x, y, z }) !=
+                          unfused.get<0>().get({ x, y, z });
+            }
+        }
+    }
+    CHECK(errors == 0);
+}
+
+TEST_CASE("apply checks the halo", "[expression]")
+{
+    grid<2, double> u({ 4, 4 }, 1);
+    grid<2, double> v({ 4, 4 }, 1);
+    auto lap = assign<1>(laplace(field<0>()));
+    CHECK_THROWS_AS(apply(fuse(lap, assign<0>(laplace(field<1>()))), u, v),
+                    std::invalid_argument);
+    CHECK_NOTHROW(apply(lap, u, v));
+}
+
+TEST_CASE("apply_periodic", "[expression]")
+{
+    grid<1, double> u({ 6 }, 0);
+    grid<1, double> v({ 6 }, 0);
+    for (u64 x = 0; x < 6; ++x) {
+        u.get({ x }) = x * x;
+    }
+    apply_periodic(assign<1>(laplace(field<0>())), u, v);
+    CHECK(v.get({ 0 }) == 25 + 1);
+    CHECK(v.get({ 2 }) == 1 + 9 - 8);
+    CHECK(v.get({ 5 }) == 16 + 0 - 50);
+}
+}
@@ -0,0 +1,96 @@
+#include <catch2/catch.hpp>
+#include <extract.hpp>
+
+namespace stencil {
+TEST_CASE("extract 2D", "[extract]")
+{
+    buffer<2, double> buf({ 7, 6 });
+    grid<2, double> g({ 5, 4 }, 1, { 1, 1 }, &buf);
+    g.fill(-1.0);
+    iterate<0>(
+        [](const std::array<u64, 2>& it, accessor<0, 2, double>& acc) {
+            acc.get({ 0, 0 }) = it[0] + 10 * it[1];
+        },
+        g);
+
+    image<double> out;
+    extract(g, slice<2>(0, 1), out);
+    REQUIRE(out.width() == 5);
+    REQUIRE(out.height() == 4);
+    for (u64 y = 0; y < 4; ++y) {
+        for (u64 x = 0; x < 5; ++x) {
+            CHECK(out(x, y) == x + 10 * y);
+        }
+    }
+
+    // transposed
+    extract(g, slice<2>(1, 0), out);
+    REQUIRE(out.width() == 4);
+    REQUIRE(out.height() == 5);
+    CHECK(out(3, 1) == 31);
+
+    // 2x2 blocks, the last column and row are partial
+    extract(g, slice<2>(0, 1, { 0, 0 }, 2, pooling::avg), out);
+    REQUIRE(out.width() == 3);
+    REQUIRE(out.height() == 2);
+    CHECK(out(0, 0) == Approx(5.5));
+    CHECK(out(2, 0) == Approx(9));
+    CHECK(out(2, 1) == Approx(29));
+
+    extract(g, slice<2>(0, 1, { 0, 0 }, 2, pooling::min), out);
+    CHECK(out(1, 1) == 22);
+    extract(g, slice<2>(0, 1, { 0, 0 }, 2, pooling::max), out);
+    CHECK(out(1, 1) == 33);
+    CHECK(out(2, 1) == 34);
+}
+
+TEST_CASE("extract slice of 3D", "[extract]")
+{
+    buffer<3, float> buf({ 6, 5, 4 });
+    grid<3, float> g({ 4, 3, 2 }, 1, { 1, 1, 1 }, &buf);
+    iterate<0>(
+        [](const std::array<u64, 3>& it, accessor<0, 3, float>& acc) {
+            acc.get({ 0, 0, 0 }) = it[0] + 10 * it[1] + 100 * it[2];
+        },
+        g);
+
+    image<float> out;
+    extract(g, slice<3>(0, 2, { 0, 2, 0 }), out);
+    REQUIRE(out.width() == 4);
+    REQUIRE(out.height() == 2);
+    for (u64 y = 0; y < 2; ++y) {
+        for (u64 x = 0; x < 4; ++x) {
+            CHECK(out(x, y) == x + 20 + 100 * y);
+        }
+    }
+
+    extract(g, slice<3>(2, 1, { 3, 0, 0 }, 3, pooling::max), out);
+    REQUIRE(out.width() == 1);
+    REQUIRE(out.height() == 1);
+    CHECK(out(0, 0) == 123);
+}
+
+TEST_CASE("render", "[extract]")
+{
+    const colormap gray = colormap::grayscale(0, 1);
+    CHECK(gray(-1) == (rgba8{ 0, 0, 0, 255 }));
+    CHECK(gray(0.5) == (rgba8{ 128, 128, 128, 255 }));
+    CHECK(gray(2) == (rgba8{ 255, 255, 255, 255 }));
+    const colormap heat = colormap::heat(0, 3);
+    CHECK(heat(1) == (rgba8{ 255, 0, 0, 255 }));
+    CHECK(heat(2) == (rgba8{ 255, 255, 0, 255 }));
+
+    buffer<2, double> buf({ 4, 4 });
+    grid<2, double> g({ 2, 2 }, 1, { 1, 1 }, &buf);
+    g.get({ 0, 0 }) = 0;
+    g.get({ 1, 0 }) = 1;
+    g.get({ 0, 1 }) = 0.5;
+    g.get({ 1, 1 }) = 0.5;
+    image<rgba8> out;
+    render(g, slice<2>(0, 1), gray, out);
+    REQUIRE(out.width() == 2);
+    CHECK(out(0, 0) == (rgba8{ 0, 0, 0, 255 }));
+    CHECK(out(1, 0) == (rgba8{ 255, 255, 255, 255 }));
+    CHECK(out(1, 1) == (rgba8{ 128, 128, 128, 255 }));
+}
+}
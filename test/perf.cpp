@@ -0,0 +1,243 @@
+#include <buffer.hpp>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <limits>
+#include <map>
+#include <string>
+#include <utility>
+
+// Throughput of representative stencils on realistic grid sizes. These tests
+// are hidden, run them with `run_tests [perf]` on an optimized build. Each
+// result is compared with the one stored in the baseline file, and the test
+// fails if it got slower by more than the tolerance, or if the baseline has no
+// result for it. Environment variables:
+//
+//   STENCIL_PERF_BASELINE   baseline file (default: perf_baseline.txt)
+//   STENCIL_PERF_TOLERANCE  allowed slowdown (default: 0.2, i.e. 20%)
+//   STENCIL_PERF_RECORD     if set, overwrite the baseline with the results
+
+namespace stencil {
+namespace {
+using baseline = std::map<std::string, double>;
+
+std::string baseline_path()
+{
+    const char* path = std::getenv("STENCIL_PERF_BASELINE");
+    return path ? path : "perf_baseline.txt";
+}
+
+baseline read_baseline()
+{
+    baseline result;
+    std::ifstream file(baseline_path());
+    std::string name;
+    double value;
+    while (file >> name >> value) {
+        result[name] = value;
+    }
+    return result;
+}
+
+void write_baseline(const baseline& values)
+{
+    std::ofstream file(baseline_path());
+    file.precision(std::numeric_limits<double>::max_digits10);
+    for (const auto& value : values) {
+        file << value.first << ' ' << value.second << '\n';
+    }
+    REQUIRE(file.good());
+}
+
+void check_throughput(const std::string& name, double cells_per_second)
+{
+    const char* tolerance_env = std::getenv("STENCIL_PERF_TOLERANCE");
+    const double tolerance = tolerance_env ? std::atof(tolerance_env) : 0.2;
+    const bool record = std::getenv("STENCIL_PERF_RECORD") != nullptr;
+
+    baseline values = read_baseline();
+    const auto stored = values.find(name);
+    WARN(name << ": " << cells_per_second * 1e-6 << " Mcells/s");
+    if (record) {
+        values[name] = cells_per_second;
+        write_baseline(values);
+        WARN("recorded as the baseline in " << baseline_path());
+        return;
+    }
+    if (stored == values.end()) {
+        FAIL("no baseline in " << baseline_path()
+                               << ", record one with STENCIL_PERF_RECORD=1");
+    }
+    INFO("baseline: " << stored->second * 1e-6 << " Mcells/s, tolerance: "
+                      << tolerance);
+    CHECK(cells_per_second >= (1 - tolerance) * stored->second);
+}
+
+// Coordinate i of the n-th neighbour within distance 1, either along the axes
+// only (center first, then -1 and +1 per axis) or in the whole 3^dim box.
+constexpr i64 neighbour(bool box, u64 n, u32 i)
+{
+    return box ? static_cast<i64>(n / ipow<u64>(3, i) % 3) - 1
+               : (n != 0 && (n - 1) / 2 == i ? ((n - 1) % 2 ? 1 : -1) : 0);
+}
+
+// The offsets are compile-time constants, as in a kernel written by hand.
+template<bool box, u64 n, u32 dim, std::size_t... I>
+double neighbour_value(accessor<1, dim, double, double>& acc,
+                       std::index_sequence<I...>)
+{
+    return acc.template get<0>(
+        { { std::integral_constant<i64, neighbour(box, n, I)>::value... } });
+}
+
+template<bool box, u32 dim, std::size_t... N>
+double neighbour_sum(accessor<1, dim, double, double>& acc,
+                     std::index_sequence<N...>)
+{
+    double sum = 0;
+    (void)std::initializer_list<int>{ (
+        sum += neighbour_value<box, N>(acc, std::make_index_sequence<dim>()),
+        0)... };
+    return sum;
+}
+
+// A weighted average over the neighbours, from field 0 into field 1.
+template<u32 dim, u64 count, bool box>
+auto average()
+{
+    static_assert(count == (box ? ipow<u64>(3, dim) : 2 * dim + 1),
+                  "wrong number of neighbours");
+    return [](const std::array<u64, dim>&,
+              accessor<1, dim, double, double>& acc) {
+        acc.template get<1>(repeat<i64, dim>(0)) =
+            (1.0 / count) *
+            neighbour_sum<box>(acc, std::make_index_sequence<count>());
+    };
+}
+
+// Seconds per call of sweep. The number of calls timed together grows until
+// they take a measurable time, the best of several runs counts.
+template<typename Func>
+double seconds_per_sweep(const Func& sweep)
+{
+    auto run = [&](u64 sweeps) {
+        const auto start = std::chrono::steady_clock::now();
+        for (u64 i = 0; i < sweeps; ++i) {
+            sweep();
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start)
+            .count();
+    };
+    u64 sweeps = 1;
+    while (run(sweeps) < 0.1) {
+        sweeps *= 2;
+    }
+    double best = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < 5; ++i) {
+        best = std::min(best, run(sweeps));
+    }
+    return best / sweeps;
+}
+
+template<u32 dim>
+u64 cell_count(const std::array<u64, dim>& size)
+{
+    u64 cells = 1;
+    for (u64 extent : size) {
+        cells *= extent;
+    }
+    return cells;
+}
+
+// Cells updated per second by average, swapping input and output between
+// sweeps.
+template<u32 dim, u64 count, bool box>
+double measure(const std::array<u64, dim>& size)
+{
+    const auto kernel = average<dim, count, box>();
+    grid_set<dim, double, double> grids(size, 1);
+    grid<dim, double>& a = grids.template get<0>();
+    grid<dim, double>& b = grids.template get<1>();
+    a.fill(1.0);
+    b.fill(1.0);
+    const double seconds = seconds_per_sweep([&] {
+        iterate<1>(kernel, a, b);
+        iterate<1>(kernel, b, a);
+    });
+    CHECK(a.get(repeat<u64, dim>(0)) == Approx(1.0));
+    return 2 * cell_count<dim>(size) / seconds;
+}
+
+// Copies the opposite edges of g into its halo, the alternative to
+// iterate_periodic.
+template<u32 dim>
+void fill_periodic_halo(grid<dim, double>& g)
+{
+    loop<dim>(repeat<u64, dim>(0),
+              repeat<u64, dim>(3),
+              [&](const std::array<u64, dim>& it) {
+                  std::array<i32, dim> relpos;
+                  bool center = true;
+                  for (u32 i = 0; i < dim; ++i) {
+                      relpos[i] = static_cast<i32>(it[i]) - 1;
+                      center = center && relpos[i] == 0;
+                  }
+                  if (!center) {
+                      g.copy_halo_from(g, relpos);
+                  }
+              });
+}
+}
+
+TEST_CASE("perf 2D 5-point", "[.][perf]")
+{
+    check_throughput("2d_5_point", measure<2, 5, false>({ 1024, 1024 }));
+}
+
+TEST_CASE("perf 3D 7-point", "[.][perf]")
+{
+    check_throughput("3d_7_point", measure<3, 7, false>({ 128, 128, 128 }));
+}
+
+TEST_CASE("perf 3D 27-point", "[.][perf]")
+{
+    check_throughput("3d_27_point", measure<3, 27, true>({ 96, 96, 96 }));
+}
+
+// Compared with filling a periodic halo and iterating as usual, on the same
+// machine and without a baseline. The grid is small, so the cells that wrap
+// around weigh in; iterate_periodic may be up to twice as slow.
+TEST_CASE("perf 3D 7-point periodic", "[.][perf]")
+{
+    const std::array<u64, 3> size = { { 32, 32, 32 } };
+    const auto kernel = average<3, 7, false>();
+    grid_set<3, double, double> grids(size, 1);
+    grid<3, double>& a = grids.get<0>();
+    grid<3, double>& b = grids.get<1>();
+    a.fill(1.0);
+    b.fill(1.0);
+    const double periodic = seconds_per_sweep([&] {
+        iterate_periodic<1>(kernel, a, b);
+        iterate_periodic<1>(kernel, b, a);
+    });
+    const double halo = seconds_per_sweep([&] {
+        fill_periodic_halo(a);
+        iterate<1>(kernel, a, b);
+        fill_periodic_halo(b);
+        iterate<1>(kernel, b, a);
+    });
+    const double cells = 2.0 * cell_count<3>(size);
+    WARN("periodic: " << cells / periodic * 1e-6 << " Mcells/s, halo: "
+                      << cells / halo * 1e-6 << " Mcells/s");
+    CHECK(periodic <= 2 * halo);
+}
+
+TEST_CASE("perf 6D 13-point", "[.][perf]")
+{
+    check_throughput("6d_13_point",
+                     measure<6, 13, false>({ 10, 10, 10, 10, 10, 10 }));
+}
+}
@@ -0,0 +1,135 @@
+#include <catch2/catch.hpp>
+#include <future>
+#include <pipeline.hpp>
+
+namespace stencil {
+namespace {
+void set_all(grid<2, int>& g, int value)
+{
+    iterate<0>(
+        [&](const std::array<u64, 2>&, accessor<0, 2, int>& acc) {
+            acc.get({ 0, 0 }) = value;
+        },
+        g);
+}
+
+int sum(const grid<2, int>& g)
+{
+    int result = 0;
+    for (u64 x = 0; x < g.size()[0]; ++x) {
+        for (u64 y = 0; y < g.size()[1]; ++y) {
+            result += g.get({ x, y });
+        }
+    }
+    return result;
+}
+}
+
+TEST_CASE("snapshot_pipeline without copies", "[pipeline]")
+{
+    buffer<2, int> buf1({ 5, 4 });
+    grid<2, int> grid1({ 3, 2 }, 1, { 1, 1 }, &buf1);
+    std::vector<int> seen;
+    snapshot_pipeline<2, int> pipeline(
+        grid1, 2, [&](const grid<2, int>& g, u64 level) {
+            CHECK(&g == &grid1);
+            seen.push_back(sum(g) + 100 * level);
+        });
+    for (int i = 0; i < 3; ++i) {
+        set_all(grid1, i);
+        pipeline.publish(grid1, i);
+        pipeline.flush();
+        pipeline.reclaim(grid1);
+    }
+    CHECK(pipeline.copies() == 0);
+    CHECK(seen == (std::vector<int>{ 0, 106, 212 }));
+}
+
+TEST_CASE("snapshot_pipeline with copies", "[pipeline]")
+{
+    buffer<2, int> buf1({ 5, 4 });
+    buffer<2, int> buf2({ 5, 4 });
+    grid<2, int> grid1({ 3, 2 }, 1, { 1, 1 }, &buf1);
+    grid<2, int> grid2({ 3, 2 }, 1, { 1, 1 }, &buf2);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::vector<std::pair<u64, int>> seen;
+    snapshot_pipeline<2, int> pipeline(
+        grid1, 1, [&](const grid<2, int>& g, u64 level) {
+            released.wait();
+            seen.emplace_back(level, sum(g));
+        });
+
+    set_all(grid1, 1);
+    pipeline.publish(grid1, 0);
+    set_all(grid2, 2);
+    pipeline.publish(grid2, 1);
+    pipeline.reclaim(grid2);
+    CHECK(pipeline.copies() == 1);
+    set_all(grid2, 3);
+    release.set_value();
+    pipeline.reclaim(grid1);
+    set_all(grid1, 4);
+    pipeline.flush();
+
+    REQUIRE(seen.size() == 2);
+    CHECK(seen[0] == std::make_pair<u64, int>(0, 6));
+    CHECK(seen[1] == std::make_pair<u64, int>(1, 12));
+}
+
+TEST_CASE("snapshot_pipeline copies the halo", "[pipeline]")
+{
+    grid<2, int> grid1({ 3, 2 }, 1), grid2({ 3, 2 }, 1);
+    grid1.fill(5);
+    grid1.fill_halo(-3);
+    grid2.fill(7);
+    grid2.fill_halo(-1);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::vector<int> halos(2, 0);
+    snapshot_pipeline<2, int> pipeline(
+        grid1, 1, [&](const grid<2, int>& g, u64 level) {
+            released.wait();
+            halos[level] = g.get_raw({ 0, 0 }) + g.get_raw({ 4, 3 });
+        });
+
+    pipeline.publish(grid1, 0);
+    pipeline.publish(grid2, 1);
+    pipeline.reclaim(grid2);
+    CHECK(pipeline.copies() == 1);
+    grid2.fill(0);
+    release.set_value();
+    pipeline.flush();
+    CHECK(halos == (std::vector<int>{ -6, -2 }));
+}
+
+TEST_CASE("snapshot_set_pipeline", "[pipeline]")
+{
+    grid_set<2, int, int> level0({ 3, 2 }, 1), level1({ 3, 2 }, 1);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::vector<std::pair<int, int>> seen;
+    snapshot_set_pipeline<2, int, int> pipeline(
+        level0, 1, [&](const grid_set<2, int, int>& g, u64) {
+            released.wait();
+            seen.emplace_back(sum(g.get<0>()), sum(g.get<1>()));
+        });
+
+    set_all(level0.get<0>(), 1);
+    set_all(level0.get<1>(), 2);
+    pipeline.publish(level0, 0);
+    set_all(level1.get<0>(), 3);
+    set_all(level1.get<1>(), 4);
+    pipeline.publish(level1, 1);
+    // both fields of level 1 are copied, so the consumer never sees a mix
+    pipeline.reclaim(level1);
+    CHECK(pipeline.copies() == 1);
+    set_all(level1.get<0>(), 5);
+    set_all(level1.get<1>(), 6);
+    release.set_value();
+    pipeline.reclaim(level0);
+    pipeline.flush();
+
+    CHECK(seen == (std::vector<std::pair<int, int>>{ { 6, 12 }, { 18, 24 } }));
+}
+}
@@ -0,0 +1,62 @@
+#include <buffer.hpp>
+#include <catch2/catch.hpp>
+#include <precision.hpp>
+
+namespace stencil {
+TEST_CASE("bfloat16", "[precision]")
+{
+    CHECK(static_cast<float>(bfloat16(1.0f)) == 1.0f);
+    CHECK(static_cast<float>(bfloat16(-3.5f)) == -3.5f);
+    // 1 + 2^-8 is halfway between two bfloat16 values, rounds to even
+    CHECK(static_cast<float>(bfloat16(1.00390625f)) == 1.0f);
+    CHECK(static_cast<float>(bfloat16(1.01171875f)) == 1.015625f);
+    CHECK(std::isnan(static_cast<float>(bfloat16(std::nanf("")))));
+}
+
+TEST_CASE("mixed precision iterate", "[precision]")
+{
+    buffer_set<2, mixed<float, double>, double> bufs({ 6, 6 });
+    grid_set<2, mixed<float, double>, double> grids({ 4, 4 }, 1, { 1, 1 }, bufs);
+    auto& stored = grids.get<0>();
+    auto& result = grids.get<1>();
+    static_assert(
+        std::is_same<std::remove_reference_t<decltype(stored.get({ 0, 0 }))>,
+                     float>::value,
+        "mixed<float, double> is stored as float");
+
+    stored.fill(0.5);
+    grids.subset<0, 1>().iterate<1>(
+        [](const std::array<u64, 2>& it,
+           accessor<1, 2, mixed<float, double>, double>& acc) {
+            acc.get<0>({ 0, 0 }) = 1.0 / 3.0 + it[0];
+            acc.get<0>({ 0, 0 }) += 1.0;
+        });
+    grids.subset<0, 1>().iterate<1>(
+        [](const std::array<u64, 2>&,
+           accessor<1, 2, mixed<float, double>, double>& acc) {
+            double value = acc.get<0>({ 0, 0 });
+            acc.get<1>({ 0, 0 }) = value * 3 - acc.get<0>({ -1, -1 });
+        });
+    auto expected = [](double x) {
+        return static_cast<float>(
+            static_cast<double>(static_cast<float>(1.0 / 3.0 + x)) + 1.0);
+    };
+    CHECK(stored.get({ 2, 1 }) == expected(2));
+    CHECK(result.get({ 0, 0 }) == 3.0 * expected(0) - 0.5);
+    CHECK(result.get({ 1, 1 }) == 3.0 * expected(1) - expected(0));
+}
+
+TEST_CASE("bfloat16 copy_halo", "[precision]")
+{
+    buffer<2, mixed<bfloat16, float>> buf1({ 4, 4 });
+    buffer<2, mixed<bfloat16, float>> buf2({ 4, 4 });
+    grid<2, mixed<bfloat16, float>> grid1({ 2, 2 }, 1, { 1, 1 }, &buf1);
+    grid<2, mixed<bfloat16, float>> grid2({ 2, 2 }, 1, { 1, 1 }, &buf2);
+    grid1.fill(2.0f);
+    grid2.fill(0.0f);
+    grid2.copy_halo_from(grid1, { -1, 0 });
+    CHECK(static_cast<float>(grid2.get_raw({ 0, 1 })) == 2.0f);
+    CHECK(static_cast<float>(grid2.get_raw({ 0, 0 })) == 0.0f);
+    CHECK(static_cast<float>(grid2.get_raw({ 1, 1 })) == 0.0f);
+}
+}
@@ -0,0 +1,187 @@
+#include <buffer.hpp>
+#include <catch2/catch.hpp>
+#include <region.hpp>
+
+namespace stencil {
+TEST_CASE("region count", "[region]")
+{
+    region<2> r1({ 1, 2 }, { 5, 4 });
+    CHECK(r1.unit_step());
+    CHECK(r1.count() == (std::array<u64, 2>{ { 4, 2 } }));
+    region<3> r2({ 0, 1, 2 }, { 7, 7, 2 }, { 2, 3, 1 });
+    CHECK_FALSE(r2.unit_step());
+    CHECK(r2.count() == (std::array<u64, 3>{ { 4, 2, 0 } }));
+}
+
+TEST_CASE("region fits", "[region]")
+{
+    CHECK(region<2>({ 1, 2 }, { 5, 4 }).fits({ 5, 4 }));
+    CHECK_FALSE(region<2>({ 1, 2 }, { 6, 4 }).fits({ 5, 4 }));
+    // the last cell visited is 6, so to may lie beyond the grid
+    CHECK(region<1>({ 0 }, { 9 }, { 3 }).fits({ 7 }));
+    CHECK_FALSE(region<1>({ 0 }, { 9 }, { 3 }).fits({ 6 }));
+    CHECK_FALSE(region<1>({ 0 }, { 4 }, { 0 }).fits({ 6 }));
+    CHECK(region<2>({ 8, 8 }, { 8, 9 }).fits({ 5, 4 }));
+
+    run_index<2> runs;
+    runs.add_run({ 2, 3 }, 3);
+    CHECK(runs.fits({ 5, 4 }));
+    CHECK_FALSE(runs.fits({ 4, 4 }));
+    CHECK_FALSE(runs.fits({ 5, 3 }));
+}
+
+TEST_CASE("iterate_region", "[region]")
+{
+    buffer<2, int> buf1({ 9, 8 });
+    grid<2, int> grid1({ 7, 6 }, 1, { 1, 1 }, &buf1);
+    iterate<0>(
+        [](const std::array<u64, 2>& it, accessor<0, 2, int>& acc) {
+            acc.get({ 0, 0 }) = 10 * it[0] + it[1];
+        },
+        grid1);
+
+    u64 visited = 0;
+    iterate_region<1>(
+        region<2>({ 2, 1 }, { 5, 4 }),
+        [&](const std::array<u64, 2>& it, accessor<1, 2, int>& acc) {
+            ++visited;
+            CHECK(it[0] >= 2);
+            CHECK(it[0] < 5);
+            CHECK(it[1] >= 1);
+            CHECK(it[1] < 4);
+            CHECK(acc.get({ 0, 0 }) == static_cast<int>(10 * it[0] + it[1]));
+            CHECK(acc.get({ 1, -1 }) ==
+                  static_cast<int>(10 * (it[0] + 1) + it[1] - 1));
+        },
+        grid1);
+    CHECK(visited == 9);
+
+    std::vector<std::array<u64, 2>> coords;
+    iterate_region<1>(
+        region<2>({ 0, 1 }, { 7, 6 }, { 3, 2 }),
+        [&](const std::array<u64, 2>& it, accessor<1, 2, int>& acc) {
+            coords.push_back(it);
+            CHECK(acc.get({ 0, 0 }) == static_cast<int>(10 * it[0] + it[1]));
+            CHECK(acc.get({ 0, -1 }) ==
+                  static_cast<int>(10 * it[0] + it[1] - 1));
+        },
+        grid1);
+    const std::vector<std::array<u64, 2>> expected = {
+        { { 0, 1 } }, { { 3, 1 } }, { { 6, 1 } }, { { 0, 3 } }, { { 3, 3 } },
+        { { 6, 3 } }, { { 0, 5 } }, { { 3, 5 } }, { { 6, 5 } },
+    };
+    CHECK(coords == expected);
+}
+
+TEST_CASE("iterate_masked", "[region]")
+{
+    auto inside = [](const std::array<u64, 2>& it) {
+        const i64 x = it[0] - 4, y = it[1] - 3;
+        return x * x + y * y <= 6;
+    };
+    auto runs = run_index<2>::from_predicate({ 9, 7 }, inside);
+
+    std::vector<bool> bits(9 * 7);
+    u64 active = 0;
+    for (u64 y = 0; y < 7; ++y) {
+        for (u64 x = 0; x < 9; ++x) {
+            bits[x + 9 * y] = inside({ x, y });
+            active += bits[x + 9 * y];
+        }
+    }
+    CHECK(runs.cell_count() == active);
+    CHECK(runs.runs().size() == 5);
+    CHECK(run_index<2>::from_bitmask({ 9, 7 }, bits).cell_count() == active);
+
+    buffer_set<2, int, int> bufs({ 11, 9 });
+    grid_set<2, int, int> grids({ 9, 7 }, 1, { 1, 1 }, bufs);
+    grids.get<0>().fill(0);
+    grids.get<1>().fill(0);
+    grids.subset<0, 1>().iterate_masked<1>(
+        runs,
+        [](const std::array<u64, 2>& it, accessor<1, 2, int, int>& acc) {
+            acc.get<0>({ 0, 0 }) += 1;
+            acc.get<1>({ 1, 0 }) = 10 * it[0] + it[1];
+        });
+    for (u64 y = 0; y < 7; ++y) {
+        for (u64 x = 0; x < 9; ++x) {
+            INFO(x << " " << y);
+            CHECK(grids.get<0>().get({ x, y }) == (inside({ x, y }) ? 1 : 0));
+            if (inside({ x, y })) {
+                CHECK(grids.get<1>().get_raw({ x + 2, y + 1 }) ==
+                      static_cast<int>(10 * x + y));
+            }
+        }
+    }
+}
+
+TEST_CASE("iterate_periodic", "[region]")
+{
+    // no halo at all, every neighbour is found by wrapping around
+    grid<2, int> values({ 5, 4 }, 0);
+    grid<2, int> sums({ 5, 4 }, 0);
+    iterate<0>(
+        [](const std::array<u64, 2>& it, accessor<0, 2, int, int>& acc) {
+            acc.get<0>({ 0, 0 }) = 10 * it[0] + it[1];
+            acc.get<1>({ 0, 0 }) = -1;
+        },
+        values,
+        sums);
+
+    std::vector<int> visits(20, 0);
+    iterate_periodic<1>(
+        [&](const std::array<u64, 2>& it, accessor<1, 2, int, int>& acc) {
+            ++visits[it[0] + 5 * it[1]];
+            int sum = 0;
+            for (i64 dx = -1; dx <= 1; ++dx) {
+                for (i64 dy = -1; dy <= 1; ++dy) {
+                    sum += acc.get<0>({ dx, dy });
+                }
+            }
+            acc.get<1>({ 0, 0 }) = sum;
+        },
+        values,
+        sums);
+    CHECK(visits == std::vector<int>(20, 1));
+    for (u64 x = 0; x < 5; ++x) {
+        for (u64 y = 0; y < 4; ++y) {
+            int expected = 0;
+            for (u64 dx = 4; dx <= 6; ++dx) {
+                for (u64 dy = 3; dy <= 5; ++dy) {
+                    expected += 10 * ((x + dx) % 5) + (y + dy) % 4;
+                }
+            }
+            INFO(x << ", " << y);
+            CHECK(sums.get({ x, y }) == expected);
+        }
+    }
+}
+
+TEST_CASE("iterate_periodic small grids", "[region]")
+{
+    // the radius exceeds half the size, so nothing is on the fast path and
+    // offsets wrap around more than once
+    buffer<3, int> buf({ 5, 4, 3 });
+    grid<3, int> g({ 3, 2, 1 }, 1, { 1, 1, 1 }, &buf);
+    iterate<0>(
+        [](const std::array<u64, 3>& it, accessor<0, 3, int>& acc) {
+            acc.get({ 0, 0, 0 }) = it[0] + 10 * it[1] + 100 * it[2];
+        },
+        g);
+
+    u64 visited = 0;
+    iterate_periodic<2>(
+        [&](const std::array<u64, 3>& it, accessor<2, 3, int>& acc) {
+            ++visited;
+            CHECK(acc.get({ 0, 0, 0 }) == static_cast<int>(it[0] + 10 * it[1]));
+            CHECK(acc.get({ 2, 0, 0 }) ==
+                  static_cast<int>((it[0] + 2) % 3 + 10 * it[1]));
+            CHECK(acc.get({ -2, 1, 0 }) ==
+                  static_cast<int>((it[0] + 1) % 3 + 10 * ((it[1] + 1) % 2)));
+            CHECK(acc.get({ 0, -2, 2 }) ==
+                  static_cast<int>(it[0] + 10 * it[1]));
+        },
+        g);
+    CHECK(visited == 6);
+}
+}
@@ -0,0 +1,103 @@
+#include <catch2/catch.hpp>
+#include <scheduler.hpp>
+
+namespace stencil {
+TEST_CASE("thread_pool", "[scheduler]")
+{
+    std::atomic<u64> counter(0);
+    {
+        thread_pool pool(4);
+        CHECK(pool.size() == 4);
+        for (u32 i = 0; i < 1000; ++i) {
+            pool.submit([&] { ++counter; });
+        }
+    }
+    CHECK(counter == 1000);
+}
+
+TEST_CASE("task_graph", "[scheduler]")
+{
+    thread_pool pool(4);
+    task_graph graph;
+    std::mutex mutex;
+    std::vector<u64> order;
+    auto record = [&](u64 id) {
+        return [&, id] {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(id);
+        };
+    };
+    const u64 a = graph.add(record(0));
+    const u64 b = graph.add(record(1), { a });
+    const u64 c = graph.add(record(2), { a });
+    graph.add(record(3), { b, c, b });
+    CHECK(graph.size() == 4);
+
+    for (u32 run = 0; run < 3; ++run) {
+        INFO("Run " << run);
+        order.clear();
+        graph.run(pool);
+        REQUIRE(order.size() == 4);
+        CHECK(order.front() == 0);
+        CHECK(order.back() == 3);
+    }
+}
+
+TEST_CASE("task_graph destroyed after run", "[scheduler]")
+{
+    thread_pool pool(4);
+    std::atomic<u64> counter(0);
+    for (u32 i = 0; i < 200; ++i) {
+        std::unique_ptr<task_graph> graph(new task_graph());
+        const u64 first = graph->add([&] { ++counter; });
+        for (u32 j = 0; j < 8; ++j) {
+            graph->add([&] { ++counter; }, { first });
+        }
+        graph->run(pool);
+    }
+    CHECK(counter == 200 * 9);
+}
+
+TEST_CASE("step_graph", "[scheduler]")
+{
+    auto kernel = [](const std::array<u64, 2>& it,
+                     accessor<1, 2, double, double>& acc) {
+        acc.get<1>({ 0, 0 }) =
+            acc.get<0>({ 0, 0 }) +
+            0.2 * (acc.get<0>({ -1, 0 }) + acc.get<0>({ 1, 0 }) +
+                   acc.get<0>({ 0, -1 }) + acc.get<0>({ 0, 1 }) -
+                   4 * acc.get<0>({ 0, 0 })) +
+            (it[0] == 5 && it[1] == 7 ? 1.0 : 0.0);
+    };
+    decomposed_grid<2, double, double> serial({ 24, 17 }, 1, 6);
+    decomposed_grid<2, double, double> scheduled({ 24, 17 }, 1, 6);
+    serial.fill<0>(0.0);
+    serial.fill<1>(0.0);
+    scheduled.fill<0>(0.0);
+    scheduled.fill<1>(0.0);
+
+    thread_pool pool(3);
+    step_graph<2, double, double> graph(scheduled);
+    graph.add_step<1, 0, 1>(kernel);
+    graph.add_step<1, 1, 0>(kernel);
+    CHECK(graph.size() == 4 * scheduled.subdomain_count());
+
+    for (u32 i = 0; i < 5; ++i) {
+        serial.exchange_halo<0>();
+        serial.iterate<1, 0, 1>(kernel);
+        serial.exchange_halo<1>();
+        serial.iterate<1, 1, 0>(kernel);
+        graph.run(pool);
+    }
+
+    for (u64 s = 0; s < serial.subdomain_count(); ++s) {
+        auto& expected = serial.get(s).get<0>();
+        auto& actual = scheduled.get(s).get<0>();
+        for (u64 x = 0; x < expected.size()[0]; ++x) {
+            for (u64 y = 0; y < expected.size()[1]; ++y) {
+                CHECK(actual.get({ x, y }) == expected.get({ x, y }));
+            }
+        }
+    }
+}
+}
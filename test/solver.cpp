@@ -0,0 +1,175 @@
+#include <catch2/catch.hpp>
+#include <solver.hpp>
+
+namespace stencil {
+namespace {
+const std::vector<std::array<i64, 2>> five_point = {
+    { { 0, 0 } }, { { -1, 0 } }, { { 1, 0 } }, { { 0, -1 } }, { { 0, 1 } },
+};
+
+struct problem
+{
+    buffer_set<2, double, double, double> bufs;
+    grid_set<2, double, double, double> grids;
+
+    problem()
+        : bufs({ 14, 11 })
+        , grids({ 12, 9 }, 1, { 1, 1 }, bufs)
+    {
+        loop<2>({ 0, 0 }, { 14, 11 }, [&](const std::array<u64, 2>& it) {
+            grids.get<0>().get_raw(it) = 0;
+            grids.get<1>().get_raw(it) = 0;
+            grids.get<2>().get_raw(it) = 0;
+        });
+        iterate<0>(
+            [](const std::array<u64, 2>& it, accessor<0, 2, double>& acc) {
+                acc.get({ 0, 0 }) = std::sin(0.7 * it[0]) + 0.1 * it[1];
+            },
+            expected());
+    }
+
+    grid<2, double>& expected() { return grids.get<0>(); }
+    grid<2, double>& rhs() { return grids.get<1>(); }
+    grid<2, double>& solution() { return grids.get<2>(); }
+
+    double max_error()
+    {
+        double error = 0;
+        for (u64 x = 0; x < 12; ++x) {
+            for (u64 y = 0; y < 9; ++y) {
+                error = std::max(error,
+                                 std::abs(solution().get({ x, y }) -
+                                          expected().get({ x, y })));
+            }
+        }
+        return error;
+    }
+};
+}
+
+TEST_CASE("stencil_operator apply", "[solver]")
+{
+    problem prob;
+    stencil_operator<2, 1, double> constant(five_point, { 4, -1, -1, -1, -1 });
+    stencil_operator<2, 1, double> variable({ 12, 9 }, five_point);
+    for (u64 x = 0; x < 12; ++x) {
+        for (u64 y = 0; y < 9; ++y) {
+            variable.coefficient({ x, y }, 0) = 4;
+            for (u64 k = 1; k < 5; ++k) {
+                variable.coefficient({ x, y }, k) = -1;
+            }
+        }
+    }
+    double dot = 0;
+    constant.apply(prob.expected(),
+                   prob.rhs(),
+                   [&](const double& x, const double& y) { dot += x * y; });
+    variable.apply(prob.expected(), prob.solution());
+
+    double expected_dot = 0;
+    for (u64 x = 0; x < 12; ++x) {
+        for (u64 y = 0; y < 9; ++y) {
+            auto& u = prob.expected();
+            double value = 4 * u.get({ x, y }) - u.get_raw({ x, y + 1 }) -
+                           u.get_raw({ x + 2, y + 1 }) -
+                           u.get_raw({ x + 1, y }) -
+                           u.get_raw({ x + 1, y + 2 });
+            INFO(x << " " << y);
+            CHECK(prob.rhs().get({ x, y }) == Approx(value));
+            CHECK(prob.solution().get({ x, y }) == prob.rhs().get({ x, y }));
+            expected_dot += u.get({ x, y }) * value;
+        }
+    }
+    CHECK(dot == Approx(expected_dot));
+}
+
+TEST_CASE("conjugate_gradient", "[solver]")
+{
+    problem prob;
+    stencil_operator<2, 1, double> op({ 12, 9 }, five_point);
+    for (u64 x = 0; x < 12; ++x) {
+        for (u64 y = 0; y < 9; ++y) {
+            op.coefficient({ x, y }, 0) = 4 + 0.1 * x;
+            for (u64 k = 1; k < 5; ++k) {
+                op.coefficient({ x, y }, k) = -1;
+            }
+        }
+    }
+    op.apply(prob.expected(), prob.rhs());
+
+    conjugate_gradient<2, double> cg(prob.solution());
+    auto result = cg.solve(op, prob.solution(), prob.rhs(), 1e-12, 200);
+    CHECK(result.converged);
+    CHECK(result.iterations > 0);
+    CHECK(result.iterations < 200);
+    CHECK(prob.max_error() < 1e-9);
+}
+
+TEST_CASE("bicgstab", "[solver]")
+{
+    problem prob;
+    stencil_operator<2, 1, double> op(five_point,
+                                      { 4.5, -1.4, -0.6, -1.2, -0.8 });
+    op.apply(prob.expected(), prob.rhs());
+
+    bicgstab<2, double> solver(prob.solution());
+    auto result = solver.solve(op, prob.solution(), prob.rhs(), 1e-12, 200);
+    CHECK(result.converged);
+    CHECK(result.iterations < 200);
+    CHECK(prob.max_error() < 1e-9);
+}
+
+TEST_CASE("bicgstab breakdown", "[solver]")
+{
+    problem prob;
+    prob.rhs().fill(1.0);
+
+    // A = 0, so r0.v vanishes in the first iteration
+    stencil_operator<2, 1, double> zero(five_point, { 0, 0, 0, 0, 0 });
+    bicgstab<2, double> solver(prob.solution());
+    auto result = solver.solve(zero, prob.solution(), prob.rhs(), 1e-12, 50);
+    CHECK_FALSE(result.converged);
+    CHECK(result.iterations < 50);
+    CHECK(std::isfinite(result.residual));
+    CHECK(prob.solution().get({ 3, 4 }) == 0);
+
+    // without a tolerance, the residual drops to exactly zero at some point
+    stencil_operator<2, 1, double> identity(five_point, { 1, 0, 0, 0, 0 });
+    result = solver.solve(identity, prob.solution(), prob.rhs(), 0, 50);
+    CHECK(result.converged);
+    CHECK(result.residual == 0);
+    CHECK(prob.solution().get({ 3, 4 }) == 1);
+}
+
+TEST_CASE("singular operators", "[solver]")
+{
+    problem prob;
+    prob.rhs().fill(1.0);
+    stencil_operator<2, 1, double> zero(five_point, { 0, 0, 0, 0, 0 });
+
+    conjugate_gradient<2, double> cg(prob.solution());
+    auto result = cg.solve(zero, prob.solution(), prob.rhs(), 1e-12, 50);
+    CHECK_FALSE(result.converged);
+    CHECK(result.iterations == 0);
+    CHECK(std::isfinite(result.residual));
+    CHECK(prob.solution().get({ 3, 4 }) == 0);
+
+    // indefinite: p.A p cancels out in the first iteration
+    stencil_operator<2, 1, double> split({ 12, 9 }, five_point);
+    for (u64 x = 0; x < 12; ++x) {
+        for (u64 y = 0; y < 9; ++y) {
+            split.coefficient({ x, y }, 0) = x < 6 ? 1 : -1;
+        }
+    }
+    result = cg.solve(split, prob.solution(), prob.rhs(), 1e-12, 50);
+    CHECK_FALSE(result.converged);
+    CHECK(std::isfinite(result.residual));
+
+    bicgstab<2, double> solver(prob.solution());
+    result = solver.solve(zero, prob.solution(), prob.rhs(), 1e-12, 50);
+    CHECK_FALSE(result.converged);
+    CHECK(result.iterations == 0);
+    CHECK(std::isfinite(result.residual));
+    CHECK(prob.solution().get({ 3, 4 }) == 0);
+}
+}